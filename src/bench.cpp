@@ -0,0 +1,483 @@
+/*
+ * bench.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+/*
+ * seven_seg_bench: time the hot paths (pixel format conversion in every
+ * SIMD tier, blitting, segment sampling and decoding) at 720p, 1080p and
+ * 4K, on synthetic scoreboard frames, then the whole pipeline over a
+ * recorded clip or a stream of synthetic frames.
+ *
+ * Results go to stdout as CSV, one line per benchmark:
+ *
+ *   benchmark,variant,width,height,iterations,ns_per_op,mpix_per_s
+ *
+ * mpix_per_s is 0 for benchmarks that don't depend on the frame size.
+ * Anything else (progress, errors) goes to stderr.
+ */
+
+#include "picture.h"
+#include "picture_kernels.h"
+#include "decoder.h"
+#include "capture.h"
+#include "destination.h"
+#include "pipeline.h"
+#include "synth.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+/* how long to repeat each benchmark, by default */
+#define DEFAULT_BENCH_TIME 0.25
+/* and the end-to-end run */
+#define DEFAULT_PIPELINE_TIME 5.0
+
+struct frame_size {
+    const char *name;
+    uint16_t w, h;
+};
+
+static const struct frame_size frame_sizes[] = {
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 },
+};
+
+#define N_FRAME_SIZES (sizeof(frame_sizes) / sizeof(frame_sizes[0]))
+
+/* every conversion Picture::convert_to_format can do in one step */
+struct conversion {
+    const char *name;
+    enum pixel_format from, to;
+    convert_row_fn picture_kernels::*kernel;
+};
+
+static const struct conversion conversions[] = {
+    { "rgb8_to_uyvy8", RGB8, UYVY8, &picture_kernels::rgb8_to_uyvy8 },
+    { "uyvy8_to_rgb8", UYVY8, RGB8, &picture_kernels::uyvy8_to_rgb8 },
+    { "yuv8_to_uyvy8", YUV8, UYVY8, &picture_kernels::yuv8_to_uyvy8 },
+    { "uyvy8_to_yuv8", UYVY8, YUV8, &picture_kernels::uyvy8_to_yuv8 },
+    { "bgra8_to_yuva8", BGRA8, YUVA8, &picture_kernels::bgra8_to_yuva8 },
+    { "bgra8_to_rgb8", BGRA8, RGB8, &picture_kernels::bgra8_to_rgb8 },
+    { "rgb8_to_y8", RGB8, A8, &picture_kernels::rgb8_to_y8 },
+    { "bgra8_to_y8", BGRA8, A8, &picture_kernels::bgra8_to_y8 },
+    { "uyvy8_to_y8", UYVY8, A8, &picture_kernels::uyvy8_to_y8 },
+    { "yuv8_to_y8", YUV8, A8, &picture_kernels::yuv8_to_y8 },
+    { "yuva8_to_y8", YUVA8, A8, &picture_kernels::yuva8_to_y8 },
+    { "yuyv8_to_uyvy8", YUYV8, UYVY8, &picture_kernels::yuyv8_to_uyvy8 },
+    { "yuyv8_to_y8", YUYV8, A8, &picture_kernels::yuyv8_to_y8 },
+};
+
+#define N_CONVERSIONS (sizeof(conversions) / sizeof(conversions[0]))
+
+static const char *const kernel_tiers[] = { "scalar", "sse2", "avx2" };
+
+static double bench_time = DEFAULT_BENCH_TIME;
+
+/* keeps results the compiler could otherwise throw away */
+static volatile uint32_t sink;
+
+/*
+ * Run fn over and over, in growing batches, for at least bench_time
+ * seconds, then print the mean time per call.
+ */
+template <class F>
+static void run(const char *name, const char *variant,
+        unsigned int w, unsigned int h, F fn) {
+    uint64_t batch = 1, iterations = 0, elapsed = 0;
+    uint64_t limit = bench_time * 1e9, start, spent, i;
+    double ns;
+
+    /* once untimed, to fault in buffers and fill the pool */
+    fn( );
+
+    while (elapsed < limit) {
+        start = monotonic_ns( );
+        for (i = 0; i < batch; ++i) {
+            fn( );
+        }
+        spent = monotonic_ns( ) - start;
+
+        elapsed += spent;
+        iterations += batch;
+        if (spent < limit / 16) {
+            batch *= 2;
+        }
+    }
+
+    ns = (double)elapsed / iterations;
+    printf("%s,%s,%u,%u,%llu,%.1f,%.1f\n", name, variant, w, h,
+        (unsigned long long)iterations, ns, ns > 0 ? w * h * 1e3 / ns : 0.0);
+    fflush(stdout);
+}
+
+/* noise, so no code path gets to skip work */
+static void fill_random(Picture *p) {
+    uint32_t x = 0x12345678;
+    unsigned int row, i;
+    uint8_t *line;
+
+    for (row = 0; row < p->h; ++row) {
+        line = p->scanline(row);
+        for (i = 0; i < p->line_pitch; ++i) {
+            /* xorshift */
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            line[i] = x;
+        }
+    }
+}
+
+static unsigned int bytes_per_pixel(enum pixel_format fmt) {
+    switch (fmt) {
+        case A8:
+            return 1;
+        case UYVY8:
+        case YUYV8:
+            return 2;
+        case RGB8:
+        case YUV8:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+static Picture *random_picture(uint16_t w, uint16_t h, enum pixel_format fmt) {
+    Picture *p = Picture::alloc(w, h, w * bytes_per_pixel(fmt), fmt);
+    fill_random(p);
+    return p;
+}
+
+static void bench_conversions(const struct frame_size *size) {
+    const struct picture_kernels *k;
+    const struct conversion *c;
+    Picture *in, *out;
+    unsigned int i, j;
+
+    for (i = 0; i < N_CONVERSIONS; ++i) {
+        c = &conversions[i];
+        in = random_picture(size->w, size->h, c->from);
+
+        /* the whole Picture path, allocation included */
+        run(c->name, get_picture_kernels( )->name, size->w, size->h, [&]( ) {
+            Picture::free(in->convert_to_format(c->to));
+        });
+
+        /* and just the row kernel, in every tier this CPU has */
+        out = Picture::alloc(size->w, size->h, 
+            size->w * bytes_per_pixel(c->to), c->to);
+        for (j = 0; j < sizeof(kernel_tiers) / sizeof(kernel_tiers[0]); ++j) {
+            k = find_picture_kernels(kernel_tiers[j]);
+            if (k == NULL) {
+                continue;
+            }
+
+            run(c->name, k->name, size->w, size->h, [&]( ) {
+                unsigned int row;
+                for (row = 0; row < size->h; ++row) {
+                    (k->*(c->kernel))(in->scanline(row), out->scanline(row),
+                        size->w);
+                }
+            });
+        }
+
+        Picture::free(out);
+        Picture::free(in);
+    }
+}
+
+/*
+ * Blit a quarter-frame overlay into the middle of the frame: opaque
+ * copies, alpha-blended BGRA8 and YUVA8, and A8 masks (as text would be).
+ */
+static void bench_draw(const struct frame_size *size) {
+    static const struct {
+        const char *variant;
+        enum pixel_format dst, src;
+    } cases[] = {
+        { "rgb8_copy", RGB8, RGB8 },
+        { "bgra8_on_rgb8", RGB8, BGRA8 },
+        { "yuva8_on_yuv8", YUV8, YUVA8 },
+        { "a8_on_rgb8", RGB8, A8 },
+        { "a8_on_yuv8", YUV8, A8 },
+    };
+    Picture *dst, *src;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        dst = random_picture(size->w, size->h, cases[i].dst);
+        src = random_picture(size->w / 2, size->h / 2, cases[i].src);
+
+        run(cases[i].src == A8 ? "drawA8" : "draw", cases[i].variant,
+                src->w, src->h, [&]( ) {
+            dst->draw(src, size->w / 4, size->h / 4, 255, 255, 0);
+        });
+
+        Picture::free(src);
+        Picture::free(dst);
+    }
+}
+
+static void bench_decoder(const struct frame_size *size) {
+    struct synth_params params;
+    std::vector<int32_t> values, shown;
+    Picture *first, *second, *next;
+    std::vector<uint32_t> sums;
+    struct scoreboard_state state;
+    unsigned int i;
+
+    /* a clean scoreboard, and the same a second later */
+    synth_default_params(&params, size->w, size->h);
+    SynthScoreboard board(&params);
+    const Layout &layout = *board.get_layout( );
+    board.next_values(&values);
+    first = board.render(values, &shown);
+    values[0] -= 10;
+    second = board.render(values, &shown);
+    sums.resize(7 * layout.digits.size( ));
+
+    static const struct {
+        const char *variant;
+        enum SamplePlan::mode mode;
+    } modes[] = {
+        { "auto", SamplePlan::AUTO },
+        { "direct", SamplePlan::DIRECT },
+        { "integral", SamplePlan::INTEGRAL },
+    };
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        SamplePlan plan(modes[i].mode);
+        plan.update(first, &layout.digits[0], layout.digits.size( ));
+
+        run("sample", modes[i].variant, size->w, size->h, [&]( ) {
+            plan.sample(first, &sums[0]);
+        });
+    }
+
+    /* the usual case: nothing lit or unlit since the last frame */
+    SamplePlan plan;
+    run("decode_layout", "unchanged", size->w, size->h, [&]( ) {
+        decode_layout(first, &layout, &plan, &state);
+    });
+
+    /* the same, with each segment checked against its own threshold */
+    AdaptiveThreshold thresholds;
+    run("decode_layout", "adaptive", size->w, size->h, [&]( ) {
+        decode_layout(first, &layout, &plan, &state, &thresholds);
+    });
+
+    /* every frame differs, so every digit and field gets reinterpreted */
+    next = second;
+    run("decode_layout", "changed", size->w, size->h, [&]( ) {
+        decode_layout(next, &layout, &plan, &state);
+        next = (next == second) ? first : second;
+    });
+
+    Picture::free(second);
+    Picture::free(first);
+}
+
+static void bench_lookup(void) {
+    struct field clock;
+    struct digit_read reads[4];
+    unsigned int i;
+
+    run("decode_segments", "all_masks", 0, 0, [&]( ) {
+        uint32_t x = 0;
+        unsigned int mask;
+        for (mask = 0; mask < 128; ++mask) {
+            x += decode_segments(mask)->value;
+        }
+        sink = x;
+    });
+
+    clock.name = "clock";
+    clock.rule = FIELD_CLOCK;
+    clock.first_digit = 0;
+    clock.n_digits = 4;
+    for (i = 0; i < 4; ++i) {
+        reads[i].value = i + 1;
+        reads[i].distance = 0;
+        reads[i].confidence = 255;
+    }
+
+    run("interpret_field", "clock", 0, 0, [&]( ) {
+        sink = interpret_field(&clock, reads);
+    });
+}
+
+/* counts what it is given, and throws it away */
+class NullDestination : public Destination {
+    public:
+        NullDestination( ) { n = 0; }
+        virtual void send(const Layout *layout,
+                const struct scoreboard_state *state) {
+            (void) layout;
+            (void) state;
+            n++;
+        }
+
+        uint64_t n;
+};
+
+/* 
+ * Decode frames from source as fast as they come, for secs seconds: a
+ * recorded clip and its layout file, or else synthetic 1080p frames.
+ */
+static void bench_pipeline(const char *source_spec, const char *layout_file,
+        double secs) {
+    struct synth_params params;
+    CaptureSource *source;
+    SynthSource *synth;
+    NullDestination dest;
+    Layout layout;
+    Pipeline *pipeline;
+    struct pipeline_stats stats;
+    uint64_t start, elapsed;
+    const LatencyHistogram *latency;
+    Picture *frame;
+    unsigned int w, h;
+
+    if (source_spec != NULL) {
+        layout.load(layout_file);
+        source = open_capture_source(source_spec);
+    } else {
+        synth_default_params(&params, 1920, 1080);
+        synth = new SynthSource(&params);
+        layout = *synth->get_layout( );
+        source = synth;
+    }
+
+    /* older layout files don't record the frame size */
+    frame = source->get_frame( );
+    if (frame == NULL) {
+        throw std::runtime_error("the source has no frames");
+    }
+    w = frame->w;
+    h = frame->h;
+    source->release_frame(frame);
+
+    pipeline = new Pipeline(source, &dest, &layout);
+    pipeline->set_preview(false);
+    pipeline->set_decoding(true);
+
+    start = monotonic_ns( );
+    pipeline->start( );
+    while (!pipeline->finished( ) && monotonic_ns( ) - start < secs * 1e9) {
+        usleep(10000);
+    }
+    pipeline->stop( );
+    elapsed = monotonic_ns( ) - start;
+
+    pipeline->get_stats(&stats);
+    latency = pipeline->total_latency( );
+
+    /* ns_per_op is per frame decoded, or the latency of a state sent */
+    printf("pipeline,fps,%u,%u,%llu,%.1f,%.1f\n", w, h,
+        (unsigned long long)stats.decoded,
+        stats.decoded ? (double)elapsed / stats.decoded : 0.0,
+        stats.decoded * 1e3 * w * h / elapsed);
+    printf("pipeline,latency_p50,%u,%u,%llu,%llu,0.0\n", w, h,
+        (unsigned long long)latency->count( ),
+        (unsigned long long)latency->quantile(0.5));
+    printf("pipeline,latency_p99,%u,%u,%llu,%llu,0.0\n", w, h,
+        (unsigned long long)latency->count( ),
+        (unsigned long long)latency->quantile(0.99));
+
+    delete pipeline;
+    delete source;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [-t secs] [-s 720p|1080p|4k]... [-i source -f layout] [-T secs]\n"
+        "  -t secs     time to spend on each benchmark (default %.2f)\n"
+        "  -s size     only these frame sizes (default: all)\n"
+        "  -i source   run the whole pipeline over this source...\n"
+        "  -f file     ...with this layout file (default: synthetic 1080p)\n"
+        "  -T secs     for this long (default %.0f, 0 = skip it)\n",
+        argv0, DEFAULT_BENCH_TIME, DEFAULT_PIPELINE_TIME);
+}
+
+int main(int argc, char **argv) {
+    const char *source_spec = NULL, *layout_file = NULL;
+    double pipeline_time = DEFAULT_PIPELINE_TIME;
+    bool wanted[N_FRAME_SIZES] = { false }, any = false;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:i:f:T:h")) != -1) {
+        switch (opt) {
+            case 't':
+                bench_time = atof(optarg);
+                break;
+            case 's':
+                for (i = 0; i < N_FRAME_SIZES; ++i) {
+                    if (strcmp(optarg, frame_sizes[i].name) == 0) {
+                        wanted[i] = any = true;
+                        break;
+                    }
+                }
+                if (i == N_FRAME_SIZES) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'i':
+                source_spec = optarg;
+                break;
+            case 'f':
+                layout_file = optarg;
+                break;
+            case 'T':
+                pipeline_time = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || (source_spec == NULL) != (layout_file == NULL)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("benchmark,variant,width,height,iterations,ns_per_op,mpix_per_s\n");
+
+    try {
+        bench_lookup( );
+
+        for (i = 0; i < N_FRAME_SIZES; ++i) {
+            if (any && !wanted[i]) {
+                continue;
+            }
+            fprintf(stderr, "%s...\n", frame_sizes[i].name);
+            bench_conversions(&frame_sizes[i]);
+            bench_draw(&frame_sizes[i]);
+            bench_decoder(&frame_sizes[i]);
+        }
+
+        if (pipeline_time > 0) {
+            fprintf(stderr, "pipeline...\n");
+            bench_pipeline(source_spec, layout_file, pipeline_time);
+        }
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what( ));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,509 @@
+/*
+ * capture.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "capture.h"
+#include "log.h"
+#include "synth.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_V4L2
+#include <linux/videodev2.h>
+#endif
+
+#include <stdexcept>
+#include <string>
+
+#ifdef HAVE_PANGOCAIRO
+StillSource::StillSource(const char *filename) {
+    image = Picture::from_png(filename);
+}
+
+StillSource::~StillSource( ) {
+    Picture::free(image);
+}
+
+Picture *StillSource::get_frame(void) {
+    Picture *frame = Picture::view(image, 0, 0, image->w, image->h);
+    frame->timestamp = monotonic_ns( );
+    return frame;
+}
+
+void StillSource::release_frame(Picture *frame) {
+    Picture::free(frame);
+}
+#endif
+
+RawFileSource::RawFileSource(const char *filename, uint16_t w, uint16_t h,
+        enum pixel_format pix_fmt) {
+    struct stat st;
+    void *addr;
+    int fd;
+
+    if (pix_fmt != UYVY8 && pix_fmt != YUYV8) {
+        throw std::runtime_error("RawFileSource: only UYVY8 and YUYV8 are supported");
+    }
+
+    if (w == 0 || h == 0 || w % 2 != 0) {
+        throw std::runtime_error("RawFileSource: bad frame size");
+    }
+    /* two bytes a pixel, and the line pitch is 16 bits */
+    if (w > 0xffff / 2) {
+        throw std::runtime_error("RawFileSource: frames are too wide");
+    }
+
+    this->w = w;
+    this->h = h;
+    this->pix_fmt = pix_fmt;
+    frame_size = (size_t)2 * w * h;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("RawFileSource: could not open file");
+    }
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("RawFileSource: could not stat file");
+    }
+
+    map_size = st.st_size;
+    n_frames = map_size / frame_size;
+    next_frame = 0;
+    if (n_frames == 0) {
+        close(fd);
+        throw std::runtime_error("RawFileSource: file is smaller than one frame");
+    }
+
+    /* private and writable, so a consumer scribbling on a frame is harmless */
+    addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("RawFileSource: mmap failed");
+    }
+
+    map = (uint8_t *)addr;
+}
+
+RawFileSource::~RawFileSource( ) {
+    munmap(map, map_size);
+}
+
+Picture *RawFileSource::get_frame(void) {
+    Picture *frame = Picture::wrap(map + next_frame * frame_size, 
+        w, h, 2 * w, pix_fmt);
+    frame->timestamp = monotonic_ns( );
+
+    next_frame++;
+    if (next_frame == n_frames) {
+        next_frame = 0;
+    }
+
+    return frame;
+}
+
+void RawFileSource::release_frame(Picture *frame) {
+    Picture::free(frame);
+}
+
+#ifdef HAVE_V4L2
+
+/* 
+ * enough for the frames the pipeline can hold (decode and preview rings,
+ * plus one in each stage) with some left over for the driver to fill
+ */
+#define N_V4L2_BUFFERS 10
+
+/* get_frame checks for interrupt( ) this often while waiting (ms) */
+#define V4L2_POLL_MS 100
+/* warn when a device has sent nothing for this long (ms) */
+#define V4L2_STALL_MS 2000
+
+/* whether a frame with this field order has its fields interleaved */
+static bool interleaved_fields(uint32_t field) {
+    switch (field) {
+        case V4L2_FIELD_NONE:
+        case V4L2_FIELD_INTERLACED:
+        case V4L2_FIELD_INTERLACED_TB:
+        case V4L2_FIELD_INTERLACED_BT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* ioctl, retried if a signal gets in the way */
+static int xioctl(int fd, unsigned long request, void *arg) {
+    int ret;
+
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+
+    return ret;
+}
+
+V4L2Source::V4L2Source(const char *device, uint16_t w, uint16_t h) {
+    static const struct {
+        uint32_t fourcc;
+        enum pixel_format pix_fmt;
+    } formats[] = {
+        { V4L2_PIX_FMT_UYVY, UYVY8 },
+        { V4L2_PIX_FMT_YUYV, YUYV8 },
+    };
+
+    struct v4l2_capability cap;
+    struct v4l2_format fmt;
+    struct v4l2_requestbuffers req;
+    struct v4l2_buffer buf;
+    struct buffer b;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    unsigned int i;
+    bool found = false;
+    void *addr;
+
+    streaming = false;
+    interrupted.store(false);
+    warned_stall = false;
+    warned_short = false;
+    /* non-blocking, so get_frame can wait in poll instead */
+    fd = open(device, O_RDWR | O_NONBLOCK);
+    if (fd == -1) {
+        throw std::runtime_error("V4L2Source: could not open device");
+    }
+
+    try {
+        memset(&cap, 0, sizeof(cap));
+        if (xioctl(fd, VIDIOC_QUERYCAP, &cap) == -1) {
+            throw std::runtime_error("V4L2Source: not a V4L2 device");
+        }
+
+        if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) 
+                || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+            throw std::runtime_error("V4L2Source: device can't stream video capture");
+        }
+
+        /* find a format we can sample without converting */
+        for (i = 0; i < sizeof(formats) / sizeof(formats[0]) && !found; ++i) {
+            memset(&fmt, 0, sizeof(fmt));
+            fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            if (xioctl(fd, VIDIOC_G_FMT, &fmt) == -1) {
+                throw std::runtime_error("V4L2Source: VIDIOC_G_FMT failed");
+            }
+
+            if (w != 0 && h != 0) {
+                fmt.fmt.pix.width = w;
+                fmt.fmt.pix.height = h;
+            }
+            fmt.fmt.pix.pixelformat = formats[i].fourcc;
+            fmt.fmt.pix.field = V4L2_FIELD_ANY;
+
+            if (xioctl(fd, VIDIOC_S_FMT, &fmt) == 0 
+                    && fmt.fmt.pix.pixelformat == formats[i].fourcc) {
+                pix_fmt = formats[i].pix_fmt;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            throw std::runtime_error("V4L2Source: device does not do UYVY or YUYV");
+        }
+
+        if (!interleaved_fields(fmt.fmt.pix.field)) {
+            /* fields one at a time or one after the other: ask for frames */
+            fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
+            if (xioctl(fd, VIDIOC_S_FMT, &fmt) == -1 
+                    || !interleaved_fields(fmt.fmt.pix.field)) {
+                throw std::runtime_error("V4L2Source: device only sends "
+                    "separate fields, which aren't supported");
+            }
+        }
+
+        /* two bytes a pixel, and the line pitch is 16 bits */
+        if (fmt.fmt.pix.width > 0xffff / 2 || fmt.fmt.pix.height > 0xffff
+                || fmt.fmt.pix.bytesperline > 0xffff) {
+            throw std::runtime_error("V4L2Source: frames are too big");
+        }
+
+        this->w = fmt.fmt.pix.width;
+        this->h = fmt.fmt.pix.height;
+        /* lines are as far apart as the driver says, not just w pixels */
+        line_pitch = fmt.fmt.pix.bytesperline;
+        if (line_pitch == 0) {
+            line_pitch = 2 * this->w;
+        }
+        if (line_pitch < 2 * this->w) {
+            throw std::runtime_error("V4L2Source: driver's lines are "
+                "shorter than a frame is wide");
+        }
+        frame_size = (size_t)this->h * line_pitch;
+
+        memset(&req, 0, sizeof(req));
+        req.count = N_V4L2_BUFFERS;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_REQBUFS, &req) == -1 || req.count < 2) {
+            throw std::runtime_error("V4L2Source: could not get mmap buffers");
+        }
+
+        for (i = 0; i < req.count; ++i) {
+            memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = i;
+            if (xioctl(fd, VIDIOC_QUERYBUF, &buf) == -1) {
+                throw std::runtime_error("V4L2Source: VIDIOC_QUERYBUF failed");
+            }
+            if (buf.length < frame_size) {
+                throw std::runtime_error("V4L2Source: driver's buffers are "
+                    "smaller than a frame");
+            }
+
+            addr = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, buf.m.offset);
+            if (addr == MAP_FAILED) {
+                throw std::runtime_error("V4L2Source: mmap failed");
+            }
+
+            b.start = (uint8_t *)addr;
+            b.length = buf.length;
+            buffers.push_back(b);
+
+            if (xioctl(fd, VIDIOC_QBUF, &buf) == -1) {
+                throw std::runtime_error("V4L2Source: VIDIOC_QBUF failed");
+            }
+        }
+
+        if (xioctl(fd, VIDIOC_STREAMON, &type) == -1) {
+            throw std::runtime_error("V4L2Source: VIDIOC_STREAMON failed");
+        }
+        streaming = true;
+    } catch (...) {
+        close_device( );
+        throw;
+    }
+
+    fprintf(stderr, "%s: %ux%u %s%s\n", device, this->w, this->h,
+        pix_fmt == UYVY8 ? "UYVY" : "YUYV",
+        fmt.fmt.pix.field == V4L2_FIELD_NONE ? "" : " interlaced");
+}
+
+V4L2Source::~V4L2Source( ) {
+    close_device( );
+}
+
+void V4L2Source::close_device(void) {
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    unsigned int i;
+
+    if (streaming) {
+        xioctl(fd, VIDIOC_STREAMOFF, &type);
+        streaming = false;
+    }
+
+    for (i = 0; i < buffers.size( ); ++i) {
+        munmap(buffers[i].start, buffers[i].length);
+    }
+    buffers.clear( );
+
+    close(fd);
+}
+
+Picture *V4L2Source::get_frame(void) {
+    struct v4l2_buffer buf;
+    struct pollfd pfd;
+    Picture *frame;
+    uint64_t waiting = monotonic_ns( );
+
+    for (;;) {
+        if (interrupted.load( )) {
+            return NULL;
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_DQBUF, &buf) == 0) {
+            /* 0 is an old driver not saying; the buffer is big enough */
+            if (buf.bytesused == 0 || buf.bytesused >= frame_size) {
+                break;
+            }
+            /* the rest of the buffer is left over from an older frame */
+            if (!warned_short) {
+                log_msg(LOG_WARNING, "warning: capture device sent a "
+                    "short frame (%u of %llu bytes); skipping it\n",
+                    buf.bytesused, (unsigned long long)frame_size);
+                warned_short = true;
+            }
+            queue_buffer(buf.index);
+            continue;
+        }
+        if (errno != EAGAIN) {
+            /* ENODEV if it was unplugged */
+            perror("VIDIOC_DQBUF");
+            return NULL;
+        }
+
+        if (!warned_stall 
+                && monotonic_ns( ) - waiting > V4L2_STALL_MS * 1000000ULL) {
+            log_msg(LOG_WARNING, "warning: no frames from the capture "
+                "device for %u s\n", V4L2_STALL_MS / 1000);
+            warned_stall = true;
+        }
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, V4L2_POLL_MS) == -1 && errno != EINTR) {
+            perror("poll");
+            return NULL;
+        }
+        if (pfd.revents & POLLERR) {
+            /* 
+             * also what poll says when we hold every buffer; DQBUF tells
+             * the two apart, but don't spin while the decoder catches up
+             */
+            usleep(1000);
+        }
+    }
+
+    warned_stall = false;
+
+    frame = Picture::wrap(buffers[buf.index].start, w, h, line_pitch, pix_fmt);
+
+    /* the driver's time is closer to the glass, if it's on our clock */
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) 
+            == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        frame->timestamp = (uint64_t)buf.timestamp.tv_sec * 1000000000ULL
+            + (uint64_t)buf.timestamp.tv_usec * 1000;
+    } else {
+        frame->timestamp = monotonic_ns( );
+    }
+
+    return frame;
+}
+
+void V4L2Source::release_frame(Picture *frame) {
+    unsigned int i;
+
+    for (i = 0; i < buffers.size( ); ++i) {
+        if (buffers[i].start == frame->data) {
+            break;
+        }
+    }
+
+    Picture::free(frame);
+
+    if (i == buffers.size( )) {
+        throw std::runtime_error("V4L2Source: released a frame it does not own");
+    }
+
+    queue_buffer(i);
+}
+
+void V4L2Source::queue_buffer(unsigned int i) {
+    struct v4l2_buffer buf;
+
+    /* hand the buffer back to the driver to fill again */
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = i;
+    if (xioctl(fd, VIDIOC_QBUF, &buf) == -1) {
+        perror("VIDIOC_QBUF");
+    }
+}
+
+#endif
+
+/* "WxH" */
+static bool parse_size(const std::string &s, uint16_t *w, uint16_t *h) {
+    unsigned int pw, ph;
+    char junk;
+
+    if (sscanf(s.c_str( ), "%ux%u%c", &pw, &ph, &junk) != 2 
+            || pw == 0 || ph == 0 || pw > 0xffff || ph > 0xffff) {
+        return false;
+    }
+
+    *w = pw;
+    *h = ph;
+    return true;
+}
+
+CaptureSource *open_capture_source(const char *spec) {
+    std::vector<std::string> parts;
+    const char *colon;
+    uint16_t w = 0, h = 0;
+    enum pixel_format pix_fmt = UYVY8;
+    struct synth_params params;
+
+    while ((colon = strchr(spec, ':')) != NULL) {
+        parts.push_back(std::string(spec, colon - spec));
+        spec = colon + 1;
+    }
+    parts.push_back(spec);
+
+#ifdef HAVE_PANGOCAIRO
+    if (parts[0] == "png" && parts.size( ) == 2) {
+        return new StillSource(parts[1].c_str( ));
+    }
+#endif
+
+    if (parts[0] == "raw" && (parts.size( ) == 3 || parts.size( ) == 4)) {
+        if (!parse_size(parts[2], &w, &h)) {
+            throw std::runtime_error("raw source size should look like 1920x1080");
+        }
+
+        if (parts.size( ) == 4) {
+            if (parts[3] == "yuyv") {
+                pix_fmt = YUYV8;
+            } else if (parts[3] != "uyvy") {
+                throw std::runtime_error("raw source format should be uyvy or yuyv");
+            }
+        }
+
+        return new RawFileSource(parts[1].c_str( ), w, h, pix_fmt);
+    }
+
+    if (parts[0] == "synth" && (parts.size( ) == 2 || parts.size( ) == 3)) {
+        if (!parse_size(parts[1], &w, &h)) {
+            throw std::runtime_error("synth source size should look like 1920x1080");
+        }
+
+        synth_default_params(&params, w, h);
+        if (parts.size( ) == 3) {
+            parse_synth_params(parts[2], &params);
+        }
+
+        return new SynthSource(&params);
+    }
+
+#ifdef HAVE_V4L2
+    if (parts[0] == "v4l2" && (parts.size( ) == 2 || parts.size( ) == 3)) {
+        if (parts.size( ) == 3 && !parse_size(parts[2], &w, &h)) {
+            throw std::runtime_error("v4l2 source size should look like 1920x1080");
+        }
+
+        return new V4L2Source(parts[1].c_str( ), w, h);
+    }
+#endif
+
+    throw std::runtime_error("unknown or unsupported capture source");
+}
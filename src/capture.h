@@ -0,0 +1,143 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+/*
+ * capture.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "picture.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/*
+ * Somewhere frames come from. Frames are handed out as non-owning
+ * Pictures over the source's own buffers, so nothing is copied between
+ * the capture and the decoder; in exchange, each frame has to be given
+ * back with release_frame once nobody needs it any more.
+ */
+class CaptureSource {
+    public:
+        CaptureSource( ) { }
+        virtual ~CaptureSource( ) { }
+
+        /* wait for the next frame; NULL at the end of the stream */
+        virtual Picture *get_frame(void) = 0;
+
+        /* return a frame from get_frame (may be called from any thread) */
+        virtual void release_frame(Picture *frame) = 0;
+
+        /*
+         * Make get_frame give up, for shutting down: from now on it
+         * returns NULL, and one already waiting does so soon. May be
+         * called from any thread. Sources that never wait long for a
+         * frame needn't do anything.
+         */
+        virtual void interrupt(void) { }
+};
+
+#ifdef HAVE_PANGOCAIRO
+/* the same PNG image over and over */
+class StillSource : public CaptureSource {
+    public:
+        StillSource(const char *filename);
+        virtual ~StillSource( );
+
+        virtual Picture *get_frame(void);
+        virtual void release_frame(Picture *frame);
+
+    protected:
+        Picture *image;
+};
+#endif
+
+/*
+ * Raw UYVY8 or YUYV8 frames of a fixed size, back to back in a file,
+ * played in a loop as fast as they are asked for. The file is mapped,
+ * so frames come straight out of the page cache, like driver buffers.
+ */
+class RawFileSource : public CaptureSource {
+    public:
+        RawFileSource(const char *filename, uint16_t w, uint16_t h,
+            enum pixel_format pix_fmt = UYVY8);
+        virtual ~RawFileSource( );
+
+        virtual Picture *get_frame(void);
+        virtual void release_frame(Picture *frame);
+
+    protected:
+        uint8_t *map;
+        size_t map_size;
+        size_t frame_size;
+        size_t n_frames, next_frame;
+        uint16_t w, h;
+        enum pixel_format pix_fmt;
+};
+
+#ifdef HAVE_V4L2
+/*
+ * Video4Linux2 capture device using streaming I/O: the driver's buffers
+ * are mapped and handed out as they are filled, and queued back to the
+ * driver on release. UYVY is preferred, YUYV is accepted. Interlaced
+ * frames must have their fields' lines interleaved (not one field per
+ * buffer, or one after the other), as split_frame expects. Lines are
+ * the driver's bytesperline apart, and a frame the driver says is short
+ * of that many lines is skipped.
+ *
+ * get_frame waits in poll, a little at a time, so interrupt( ) gets
+ * through even if the device has stopped sending; one that has gone
+ * away ends the stream.
+ */
+class V4L2Source : public CaptureSource {
+    public:
+        /* w = h = 0 keeps whatever size the device is set to */
+        V4L2Source(const char *device, uint16_t w = 0, uint16_t h = 0);
+        virtual ~V4L2Source( );
+
+        virtual Picture *get_frame(void);
+        virtual void release_frame(Picture *frame);
+        virtual void interrupt(void) { interrupted.store(true); }
+
+    protected:
+        struct buffer {
+            uint8_t *start;
+            size_t length;
+        };
+
+        void close_device(void);
+        /* give buffer i back to the driver */
+        void queue_buffer(unsigned int i);
+
+        int fd;
+        bool streaming;
+        std::atomic<bool> interrupted;
+        /* we've complained about the device going quiet */
+        bool warned_stall;
+        /* ...or sending a frame short of frame_size */
+        bool warned_short;
+        std::vector<struct buffer> buffers;
+        uint16_t w, h, line_pitch;
+        /* h lines of line_pitch bytes */
+        size_t frame_size;
+        enum pixel_format pix_fmt;
+};
+#endif
+
+/*
+ * Open a source from a description:
+ *   png:FILE
+ *   raw:FILE:WxH[:uyvy|:yuyv]
+ *   v4l2:DEVICE[:WxH]
+ *   synth:WxH[:SETTINGS]   (see SynthScoreboard and parse_synth_params)
+ * Throws std::runtime_error if it can't.
+ */
+CaptureSource *open_capture_source(const char *spec);
+
+#endif
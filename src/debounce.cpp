@@ -0,0 +1,204 @@
+/*
+ * debounce.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "debounce.h"
+#include "log.h"
+#include "predictor.h"
+
+#include <stdlib.h>
+
+/* no candidate; digit_read values go down to -1 */
+#define NO_CANDIDATE (-2)
+
+DigitFilter::DigitFilter(LatencyHistogram *delay) {
+    this->delay = delay;
+    frames = 1;
+    n_immediate.store(0);
+    n_delayed.store(0);
+    n_suppressed.store(0);
+}
+
+void DigitFilter::set_frames(unsigned int frames) {
+    if (frames != this->frames) {
+        this->frames = frames;
+        reset( );
+    }
+}
+
+void DigitFilter::reset(void) {
+    tracks.clear( );
+    clocks.clear( );
+}
+
+void DigitFilter::believe(unsigned int i, const struct digit_read *read,
+        uint64_t now) {
+    struct digit_track *t = &tracks[i];
+
+    if (now != t->since) {
+        log_msg(LOG_DEBUG, "digit %u: %d believed after %.1f ms\n", i,
+            read->value, (now - t->since) / 1e6);
+    }
+
+    t->believed = *read;
+    t->candidate = NO_CANDIDATE;
+}
+
+bool DigitFilter::apply(const Layout *layout, 
+        const struct scoreboard_state *in, bool changed, 
+        struct scoreboard_state *out) {
+    unsigned int i, j, n_digits = in->digits.size( );
+    uint64_t now = in->capture_time;
+    const struct field *f;
+    struct digit_track *t;
+    const struct digit_read *r;
+    int32_t from, to;
+    struct clock_track *c;
+    int dir;
+    bool pending, believed = false;
+
+    *out = *in;
+
+    if (frames <= 1) {
+        return changed;
+    }
+
+    if (tracks.size( ) != n_digits) {
+        /* a fresh start: believe the first frame */
+        tracks.resize(n_digits);
+        clocks.resize(layout->fields.size( ));
+        for (j = 0; j < layout->fields.size( ); ++j) {
+            f = &layout->fields[j];
+            clocks[j].value = interpret_field(f, &in->digits[f->first_digit]);
+            clocks[j].since = now;
+            clocks[j].dir = 0;
+        }
+        for (i = 0; i < n_digits; ++i) {
+            tracks[i].believed = in->digits[i];
+            tracks[i].candidate = NO_CANDIDATE;
+            tracks[i].count = 0;
+            tracks[i].since = now;
+        }
+        return true;
+    }
+
+    for (i = 0; i < n_digits; ++i) {
+        t = &tracks[i];
+        r = &in->digits[i];
+
+        if (r->value == t->believed.value) {
+            if (t->candidate != NO_CANDIDATE) {
+                n_suppressed++;
+                t->candidate = NO_CANDIDATE;
+            }
+            /* the confidence may have changed */
+            t->believed = *r;
+            continue;
+        }
+
+        if (r->value == t->candidate) {
+            t->count++;
+        } else {
+            if (t->candidate != NO_CANDIDATE) {
+                n_suppressed++;
+            }
+            t->candidate = r->value;
+            t->count = 1;
+            t->since = now;
+        }
+
+        if (t->count >= frames) {
+            n_delayed++;
+            if (delay != NULL) {
+                delay->record(now - t->since);
+            }
+            believe(i, r, now);
+            believed = true;
+        }
+    }
+
+    /* a clock stepping as clocks do can be believed right away */
+    trial.resize(n_digits);
+    for (j = 0; j < layout->fields.size( ); ++j) {
+        f = &layout->fields[j];
+        c = &clocks[j];
+        if (f->rule != FIELD_CLOCK) {
+            continue;
+        }
+
+        pending = false;
+        for (i = f->first_digit; i < f->first_digit + f->n_digits; ++i) {
+            trial[i] = tracks[i].believed;
+        }
+        from = interpret_field(f, &trial[f->first_digit]);
+
+        for (i = f->first_digit; i < f->first_digit + f->n_digits; ++i) {
+            if (tracks[i].candidate != NO_CANDIDATE) {
+                trial[i] = in->digits[i];
+                pending = true;
+            }
+        }
+        if (!pending || from == FIELD_INVALID) {
+            continue;
+        }
+
+        to = interpret_field(f, &trial[f->first_digit]);
+        if (to == FIELD_INVALID || to == from) {
+            continue;
+        }
+        /* not seen stepping yet: either way will do */
+        dir = (c->dir != 0) ? c->dir : (to < from) ? -1 : 1;
+        /* a step of a tenth takes 100 ms */
+        if (to != clock_next(from, dir) || now - c->since 
+                < (uint64_t)abs(to - from) * 50000000ULL) {
+            continue;
+        }
+
+        for (i = f->first_digit; i < f->first_digit + f->n_digits; ++i) {
+            if (tracks[i].candidate != NO_CANDIDATE) {
+                /* the filter cost this change nothing */
+                n_immediate++;
+                if (delay != NULL) {
+                    delay->record(0);
+                }
+                believe(i, &in->digits[i], now);
+                believed = true;
+            }
+        }
+    }
+
+    for (i = 0; i < n_digits; ++i) {
+        out->digits[i] = tracks[i].believed;
+    }
+    for (j = 0; j < layout->fields.size( ); ++j) {
+        f = &layout->fields[j];
+        out->values[j] = interpret_field(f, &out->digits[f->first_digit]);
+
+        c = &clocks[j];
+        if (out->values[j] == c->value) {
+            continue;
+        }
+        if (c->value != FIELD_INVALID && out->values[j] != FIELD_INVALID) {
+            if (out->values[j] == clock_next(c->value, -1)) {
+                c->dir = -1;
+            } else if (out->values[j] == clock_next(c->value, 1)) {
+                c->dir = 1;
+            }
+        }
+        c->value = out->values[j];
+        c->since = now;
+    }
+
+    return believed;
+}
+
+void DigitFilter::get_stats(struct debounce_stats *stats) {
+    stats->immediate = n_immediate.load( );
+    stats->delayed = n_delayed.load( );
+    stats->suppressed = n_suppressed.load( );
+}
@@ -0,0 +1,109 @@
+#ifndef _DEBOUNCE_H
+#define _DEBOUNCE_H
+
+/*
+ * debounce.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "decoder.h"
+#include "histogram.h"
+#include "layout.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+/* what a DigitFilter has decided so far */
+struct debounce_stats {
+    uint64_t immediate;     /* digit changes believed at once */
+    uint64_t delayed;       /* believed after enough frames agreed */
+    uint64_t suppressed;    /* reads that went away before that */
+};
+
+/*
+ * Keeps glitches out of the decoded values: a digit read off a frame
+ * that caught the board mid-change (LED multiplexing, a rolling shutter)
+ * can come out wrong or unreadable for a frame or two.
+ *
+ * Each digit keeps the value last believed. A different read becomes a
+ * candidate, which is believed once it has been read in frames (fields,
+ * with -I) in a row. Changes a clock would make anyway don't wait: when
+ * a clock field's candidates make it one step (see clock_next) from
+ * what it showed, the same way it stepped last time, and at least half
+ * that step's time (clocks count in tenths of a second) after it last
+ * changed, they are all believed at once. So a running clock
+ * isn't held up, and neither is anything else that's steady; the cost
+ * is paid only by changes nobody could have predicted (a score, a reset).
+ * How long every change waited (0, if it didn't) goes into a histogram.
+ *
+ * The output state is the input with the believed digits, and the
+ * values made from them.
+ */
+class DigitFilter {
+    public:
+        /*
+         * how long (ns) each change believed was held back goes into
+         * delay, if given; 0 for those believed straight away
+         */
+        DigitFilter(LatencyHistogram *delay = NULL);
+
+        /* 
+         * Reads agreeing in this many frames are believed; 1 (the
+         * default) believes everything at once, as if there were no
+         * filter.
+         */
+        void set_frames(unsigned int frames);
+        /* forget everything, e.g. when the layout changes */
+        void reset(void);
+
+        /* 
+         * Filter one frame's decode into out. changed is what
+         * decode_layout returned; returns whether any value believed
+         * changed (with no filtering, just changed).
+         */
+        bool apply(const Layout *layout, const struct scoreboard_state *in,
+            bool changed, struct scoreboard_state *out);
+
+        /* safe to call from any thread */
+        void get_stats(struct debounce_stats *stats);
+
+    protected:
+        struct digit_track {
+            /* what is believed */
+            struct digit_read believed;
+            /* a different value read lately (-2 = none), and for how long */
+            int8_t candidate;
+            unsigned int count;
+            /* capture time of the first frame it was read in */
+            uint64_t since;
+        };
+
+        void believe(unsigned int i, const struct digit_read *read, 
+            uint64_t now);
+
+        LatencyHistogram *delay;
+        unsigned int frames;
+        std::vector<struct digit_track> tracks;
+        struct clock_track {
+            /* the value believed, and when it was first read */
+            int32_t value;
+            uint64_t since;
+            /* which way it was last seen stepping (0 = unknown) */
+            int dir;
+        };
+
+        /* one per field; only clock fields' are used */
+        std::vector<struct clock_track> clocks;
+        /* scratch: the believed reads with a field's candidates swapped in */
+        std::vector<struct digit_read> trial;
+
+        std::atomic<uint64_t> n_immediate, n_delayed, n_suppressed;
+};
+
+#endif
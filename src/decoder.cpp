@@ -0,0 +1,527 @@
+/*
+ * decoder.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the 
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "decoder.h"
+#include "timing.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <stdexcept>
+
+#define SEG(n) (1 << (n))
+
+/* lit segments of each digit; bit n is segment n */
+static constexpr uint8_t digit_masks[] = {
+    /* 0 */ SEG(1) | SEG(2) | SEG(3) | SEG(4) | SEG(5) | SEG(6),
+    /* 1 */ SEG(3) | SEG(4),
+    /* 2 */ SEG(0) | SEG(1) | SEG(2) | SEG(4) | SEG(5),
+    /* 3 */ SEG(0) | SEG(2) | SEG(3) | SEG(4) | SEG(5),
+    /* 4 */ SEG(0) | SEG(3) | SEG(4) | SEG(6),
+    /* 5 */ SEG(0) | SEG(2) | SEG(3) | SEG(5) | SEG(6),
+    /* 6 */ SEG(0) | SEG(1) | SEG(2) | SEG(3) | SEG(5) | SEG(6),
+    /* 7 */ SEG(3) | SEG(4) | SEG(5),
+    /* 8 */ SEG(0) | SEG(1) | SEG(2) | SEG(3) | SEG(4) | SEG(5) | SEG(6),
+    /* 9 */ SEG(0) | SEG(2) | SEG(3) | SEG(4) | SEG(5) | SEG(6),
+    /* an all-dead digit #0 means to interpret 1-3 as :ss.t */
+    /* DIGIT_BLANK */ 0
+};
+
+#undef SEG
+
+/* confidence lost per segment that disagrees with the digit read */
+#define DISTANCE_PENALTY 32
+
+static constexpr int popcount7(unsigned int x) {
+    int n = 0;
+    for (; x != 0; x &= x - 1) {
+        ++n;
+    }
+    return n;
+}
+
+struct segment_lut {
+    struct segment_decode entry[128];
+};
+
+/*
+ * For every possible mask, the digit whose pattern is fewest segments
+ * away. If two digits tie for nearest, the read is ambiguous (value -1).
+ */
+static constexpr struct segment_lut make_segment_lut(void) {
+    struct segment_lut lut = { };
+
+    for (unsigned int mask = 0; mask < 128; ++mask) {
+        int best = 8;
+        lut.entry[mask].value = -1;
+
+        for (int i = 0; i <= DIGIT_BLANK; ++i) {
+            int d = popcount7(mask ^ digit_masks[i]);
+            if (d < best) {
+                best = d;
+                lut.entry[mask].value = i;
+            } else if (d == best) {
+                lut.entry[mask].value = -1;
+            }
+        }
+
+        lut.entry[mask].distance = best;
+    }
+
+    return lut;
+}
+
+static constexpr struct segment_lut segment_lut = make_segment_lut( );
+
+/* every digit has to decode exactly from its own pattern */
+static_assert(segment_lut.entry[digit_masks[8]].value == 8
+        && segment_lut.entry[digit_masks[8]].distance == 0,
+        "segment table is broken");
+
+const struct segment_decode *decode_segments(uint8_t mask) {
+    return &segment_lut.entry[mask & 0x7f];
+}
+
+uint8_t digit_segments(int digit) {
+    if (digit < 0 || digit > DIGIT_BLANK) {
+        return 0;
+    }
+    return digit_masks[digit];
+}
+
+SamplePlan::SamplePlan(enum mode mode) {
+    requested_mode = mode;
+    w = h = line_pitch = x_offset = y_offset = 0;
+    pix_fmt = A8;
+    field = PICTURE_FRAME;
+    stride = 1;
+    estimate_from_rgb = false;
+    use_integral = false;
+    bbox_x = bbox_y = bbox_w = bbox_h = 0;
+}
+
+bool SamplePlan::matches(Picture *p, const struct digit *digits, 
+        int n_digits) const {
+    return p->w == w && p->h == h && p->line_pitch == line_pitch
+        && p->x_offset == x_offset && p->y_offset == y_offset
+        && p->pix_fmt == pix_fmt && p->field == field
+        && layout.size( ) == (size_t)n_digits
+        && memcmp(&layout[0], digits, n_digits * sizeof(struct digit)) == 0;
+}
+
+bool SamplePlan::update(Picture *p, const struct digit *digits, int n_digits) {
+    if (!seg_end.empty( ) && matches(p, digits, n_digits)) {
+        return false;
+    }
+
+    build(p, digits, n_digits);
+    return true;
+}
+
+void SamplePlan::build(Picture *p, const struct digit *digits, int n_digits) {
+    unsigned int luma_offset = 0, first_line;
+    int i, j, y, x0, x1, y0, y1, bw, bh;
+    int bx0, by0, bx1, by1;
+    uint32_t box_pixels = 0;
+    const struct point *pt;
+    struct run r;
+    struct corners c;
+    /* clipped boxes in picture coordinates, [x0, x1) x [y0, y1) */
+    std::vector<int> rects;
+
+    /* where Y lives in each pixel; RGB has to be estimated from 3 bytes */
+    estimate_from_rgb = false;
+    switch (p->pix_fmt) {
+        case A8:
+            stride = 1;
+            break;
+
+        case UYVY8:
+            stride = 2;
+            luma_offset = 1;
+            break;
+
+        case YUYV8:
+            stride = 2;
+            break;
+
+        case YUV8:
+            stride = 3;
+            break;
+
+        case YUVA8:
+            stride = 4;
+            break;
+
+        case RGB8:
+            stride = 3;
+            estimate_from_rgb = true;
+            break;
+
+        case BGRA8:
+            /* b and r trade places, which the estimate doesn't care about */
+            stride = 4;
+            estimate_from_rgb = true;
+            break;
+
+        default:
+            throw std::runtime_error("SamplePlan: unsupported pixel format");
+    }
+
+    w = p->w;
+    h = p->h;
+    line_pitch = p->line_pitch;
+    x_offset = p->x_offset;
+    y_offset = p->y_offset;
+    pix_fmt = p->pix_fmt;
+    field = p->field;
+    layout.assign(digits, digits + n_digits);
+    /* the frame line that is line 0 of the field */
+    first_line = (field == PICTURE_BOTTOM_FIELD) ? 1 : 0;
+
+    runs.clear( );
+    seg_end.clear( );
+    seg_area.clear( );
+    seg_corners.clear( );
+
+    bx0 = w;
+    by0 = h;
+    bx1 = by1 = 0;
+
+    /* 
+     * Points are in frame coordinates. Like always, row and column 0 of 
+     * the frame are never sampled.
+     */
+    for (i = 0; i < n_digits; ++i) {
+        for (j = 0; j < 7; ++j) {
+            pt = &digits[i].segment_pos[j];
+            bw = digits[i].segment_size[j].w ? digits[i].segment_size[j].w : DEFAULT_BOX;
+            bh = digits[i].segment_size[j].h ? digits[i].segment_size[j].h : DEFAULT_BOX;
+
+            x0 = pt->x - bw / 2;
+            y0 = pt->y - bh / 2;
+            x1 = x0 + bw;
+            y1 = y0 + bh;
+            y0 = y0 < 1 ? 1 : y0;
+
+            if (field != PICTURE_FRAME) {
+                /* just this field's lines of the box, in field lines */
+                y0 = (y0 - first_line + 1) / 2;
+                y1 = y1 > (int)first_line ? (y1 - first_line + 1) / 2 : 0;
+                y1 = y1 > y0 ? y1 : y0 + 1;
+                bh = y1 - y0;
+            }
+            seg_area.push_back(bw * bh);
+
+            /* clip, and move into picture coordinates */
+            x0 = (x0 < 1 ? 1 : x0) - x_offset;
+            y0 -= y_offset;
+            x1 -= x_offset;
+            y1 -= y_offset;
+            x0 = x0 < 0 ? 0 : x0;
+            y0 = y0 < 0 ? 0 : y0;
+            x1 = x1 > w ? w : x1;
+            y1 = y1 > h ? h : y1;
+            if (x1 <= x0 || y1 <= y0) {
+                x0 = x1 = y0 = y1 = 0;
+            } else {
+                bx0 = x0 < bx0 ? x0 : bx0;
+                by0 = y0 < by0 ? y0 : by0;
+                bx1 = x1 > bx1 ? x1 : bx1;
+                by1 = y1 > by1 ? y1 : by1;
+            }
+
+            rects.push_back(x0);
+            rects.push_back(y0);
+            rects.push_back(x1);
+            rects.push_back(y1);
+
+            /* one run per row of the box */
+            for (y = y0; y < y1; ++y) {
+                r.offset = y * line_pitch + x0 * stride + luma_offset;
+                r.count = x1 - x0;
+                runs.push_back(r);
+                box_pixels += r.count;
+            }
+
+            seg_end.push_back(runs.size( ));
+        }
+    }
+
+    if (bx1 <= bx0 || by1 <= by0) {
+        /* nothing on screen at all */
+        bx0 = by0 = bx1 = by1 = 0;
+    }
+
+    /* UYVY8 and YUYV8 pictures can only be cut between pixel pairs */
+    bx0 &= ~1;
+    bx1 = (bx1 + 1) & ~1;
+    bx1 = bx1 > w ? w : bx1;
+
+    bbox_x = bx0;
+    bbox_y = by0;
+    bbox_w = bx1 - bx0;
+    bbox_h = by1 - by0;
+
+    /* 
+     * Summing the boxes directly touches box_pixels pixels; the table 
+     * touches every pixel of the bounding box (a few times over).
+     */
+    if (requested_mode == AUTO) {
+        use_integral = box_pixels > 2 * (uint32_t)bbox_w * bbox_h;
+    } else {
+        use_integral = (requested_mode == INTEGRAL);
+    }
+
+    for (i = 0; i < (int)rects.size( ); i += 4) {
+        if (rects[i + 2] == 0) {
+            /* empty box: every corner on the zero row */
+            c.a = c.b = c.c = c.d = 0;
+        } else {
+            x0 = rects[i] - bx0;
+            y0 = rects[i + 1] - by0;
+            x1 = rects[i + 2] - bx0;
+            y1 = rects[i + 3] - by0;
+            c.a = y1 * (bbox_w + 1) + x1;
+            c.b = y0 * (bbox_w + 1) + x1;
+            c.c = y1 * (bbox_w + 1) + x0;
+            c.d = y0 * (bbox_w + 1) + x0;
+        }
+        seg_corners.push_back(c);
+    }
+}
+
+void SamplePlan::sample(Picture *p, uint32_t *sums) {
+    const uint8_t *data = p->data;
+    const uint8_t *s;
+    const uint32_t *t;
+    uint32_t sum;
+    size_t seg, i = 0;
+    unsigned int k;
+
+    if (use_integral) {
+        integral.build(p, bbox_x, bbox_y, bbox_w, bbox_h);
+        t = integral.data( );
+        for (seg = 0; seg < seg_corners.size( ); ++seg) {
+            sums[seg] = t[seg_corners[seg].a] - t[seg_corners[seg].b] 
+                - t[seg_corners[seg].c] + t[seg_corners[seg].d];
+        }
+        return;
+    }
+
+    for (seg = 0; seg < seg_end.size( ); ++seg) {
+        sum = 0;
+
+        if (estimate_from_rgb) {
+            for (; i < seg_end[seg]; ++i) {
+                s = data + runs[i].offset;
+                for (k = 0; k < runs[i].count; ++k) {
+                    /* crudely estimate y as (r + 2g + b) / 4 */
+                    sum += (s[0] + 2 * s[1] + s[2]) >> 2;
+                    s += stride;
+                }
+            }
+        } else {
+            for (; i < seg_end[seg]; ++i) {
+                s = data + runs[i].offset;
+                for (k = 0; k < runs[i].count; ++k) {
+                    sum += *s;
+                    s += stride;
+                }
+            }
+        }
+
+        sums[seg] = sum;
+    }
+}
+
+static int32_t interpret_clock(const struct digit_read *reads, unsigned int n) {
+    /* tenths of a second per unit of each digit, as MM:SS */
+    static const int32_t mmss_weight[] = { 10, 100, 600, 6000 };
+    int32_t clock = 0, weight;
+    unsigned int i;
+
+    if (reads[0].value == DIGIT_BLANK) {
+        /* an all-dead digit #0 means to interpret the rest as :ss.t */
+        weight = 1;
+        for (i = 1; i < n; ++i) {
+            if (reads[i].value != DIGIT_BLANK) {
+                clock += reads[i].value * weight;
+            }
+            weight *= 10;
+        }
+        return clock;
+    }
+
+    if (n >= 4 && reads[3].value >= 6 && reads[3].value != DIGIT_BLANK) {
+        log_msg(LOG_DEBUG, "warning: non-sensical time being decoded\n");
+    }
+
+    for (i = 0; i < n; ++i) {
+        weight = (i < 4) ? mmss_weight[i] : weight * 10;
+        /* probably a leading blank */
+        if (reads[i].value != DIGIT_BLANK) {
+            clock += reads[i].value * weight;
+        }
+    }
+
+    return clock;
+}
+
+static int32_t interpret_integer(const struct digit_read *reads, unsigned int n) {
+    int32_t value = 0;
+    unsigned int i;
+
+    for (i = n; i > 0; --i) {
+        value *= 10;
+        /* leading blanks read as 0 */
+        if (reads[i - 1].value != DIGIT_BLANK) {
+            value += reads[i - 1].value;
+        }
+    }
+
+    return value;
+}
+
+int32_t interpret_field(const struct field *f, const struct digit_read *reads) {
+    unsigned int i;
+
+    for (i = 0; i < f->n_digits; ++i) {
+        if (reads[i].value == -1) {
+            return FIELD_INVALID;
+        }
+    }
+
+    switch (f->rule) {
+        case FIELD_CLOCK:
+            return interpret_clock(reads, f->n_digits);
+        case FIELD_INTEGER:
+            return interpret_integer(reads, f->n_digits);
+    }
+
+    return FIELD_INVALID;
+}
+
+/* 
+ * Find each digit's lit segments from its sums; true if any changed.
+ * With learn, thresholds learn from the frame (begin and classify,
+ * leaving end to the caller); otherwise they are only looked at.
+ */
+static bool update_masks(const Layout *layout, const SamplePlan *plan,
+        AdaptiveThreshold *thresholds, bool learn,
+        struct scoreboard_state *state) {
+    unsigned int i, j, seg, n_digits = layout->digits.size( );
+    uint8_t mask;
+    bool lit, changed = false;
+
+    if (thresholds != NULL && learn) {
+        thresholds->begin(n_digits * 7, layout->threshold);
+    }
+
+    for (i = 0; i < n_digits; ++i) {
+        mask = 0;
+        for (j = 0; j < 7; ++j) {
+            seg = i * 7 + j;
+            if (thresholds != NULL && learn) {
+                lit = thresholds->classify(seg, state->sums[seg], 
+                    plan->area(seg));
+            } else if (thresholds != NULL) {
+                lit = thresholds->is_lit(seg, state->sums[seg], 
+                    plan->area(seg));
+            } else {
+                /* mean luma over the box above the threshold */
+                lit = state->sums[seg] 
+                    > (uint64_t)layout->threshold * plan->area(seg);
+            }
+            if (lit) {
+                mask |= 1 << j;
+            }
+        }
+
+        if (mask != state->masks[i]) {
+            state->masks[i] = mask;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool decode_layout(Picture *p, const Layout *layout, SamplePlan *plan,
+        struct scoreboard_state *state, AdaptiveThreshold *thresholds) {
+    unsigned int i, n_digits = layout->digits.size( );
+    bool changed;
+    const struct segment_decode *decoded;
+    const struct field *f;
+
+    changed = state->masks.size( ) != n_digits 
+        || state->values.size( ) != layout->fields.size( );
+
+    state->capture_time = p->timestamp;
+    state->flags = 0;
+    state->sums.resize(n_digits * 7);
+    state->masks.resize(n_digits);
+    state->digits.resize(n_digits);
+    state->values.resize(layout->fields.size( ));
+
+    if (n_digits == 0) {
+        state->decode_time = monotonic_ns( );
+        return changed;
+    }
+
+    if (plan->update(p, &layout->digits[0], n_digits)) {
+        changed = true;
+    }
+    plan->sample(p, &state->sums[0]);
+
+    if (update_masks(layout, plan, thresholds, true, state)) {
+        changed = true;
+    }
+    if (thresholds != NULL && thresholds->end( )) {
+        /* the thresholds started over: use the new ones */
+        if (update_masks(layout, plan, thresholds, false, state)) {
+            changed = true;
+        }
+    }
+
+    state->decode_time = monotonic_ns( );
+
+    /* same lit segments as last time: the reads and values still hold */
+    if (!changed) {
+        return false;
+    }
+
+    for (i = 0; i < n_digits; ++i) {
+        decoded = decode_segments(state->masks[i]);
+        state->digits[i].distance = decoded->distance;
+
+        if (decoded->value == -1 || decoded->distance > MAX_SEGMENT_ERRORS) {
+            log_msg(LOG_DEBUG, "warning: could not decode digit %u\n", i);
+            state->digits[i].value = -1;
+            state->digits[i].confidence = 0;
+            continue;
+        }
+
+        state->digits[i].value = decoded->value;
+        state->digits[i].confidence = 255 - DISTANCE_PENALTY * decoded->distance;
+
+        if (decoded->distance > 0) {
+            log_msg(LOG_DEBUG, "warning: digit %u read as %d with %d bad segment(s)\n",
+                i, decoded->value, decoded->distance);
+        }
+    }
+
+    for (i = 0; i < layout->fields.size( ); ++i) {
+        f = &layout->fields[i];
+        state->values[i] = interpret_field(f, &state->digits[f->first_digit]);
+    }
+
+    return true;
+}
@@ -0,0 +1,183 @@
+#ifndef _DECODER_H
+#define _DECODER_H
+
+/*
+ * decoder.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "picture.h"
+#include "integral.h"
+#include "layout.h"
+#include "threshold.h"
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * The sample boxes of a digit layout, compiled for one frame geometry
+ * and pixel format, and clipped to the picture.
+ *
+ * Small boxes become a few runs of pixels (byte offset from the top-left
+ * of the picture, and a length), so sampling a frame is one tight loop
+ * over a flat table. When the boxes are big enough that summing them
+ * pixel by pixel costs more than a summed-area table over their bounding
+ * box, the table is built each frame instead, and each box is then four
+ * lookups at precomputed indices.
+ *
+ * A plan can be built for a field (see Picture::field_view) as well as a
+ * frame: the boxes, which are in frame coordinates, keep just the lines
+ * of that field (at least one each). The two fields want different
+ * plans, so decoding fields means keeping a plan for each.
+ *
+ * The plan is rebuilt only when the layout or the geometry changes.
+ */
+class SamplePlan {
+    public:
+        enum mode { AUTO, DIRECT, INTEGRAL };
+
+        SamplePlan(enum mode mode = AUTO);
+
+        /* make sure the plan fits this picture and layout; true if rebuilt */
+        bool update(Picture *p, const struct digit *digits, int n_digits);
+
+        /* luma sum of each segment's box, 7 per digit, into sums */
+        void sample(Picture *p, uint32_t *sums);
+
+        int n_segments(void) const { return seg_end.size( ); }
+
+        /* nominal (unclipped) area of segment i's box */
+        uint32_t area(int i) const { return seg_area[i]; }
+
+        bool using_integral(void) const { return use_integral; }
+
+    protected:
+        struct run {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        /* table indices of a box's corners, see IntegralImage */
+        struct corners {
+            uint32_t a, b, c, d;
+        };
+
+        void build(Picture *p, const struct digit *digits, int n_digits);
+        bool matches(Picture *p, const struct digit *digits, int n_digits) const;
+
+        enum mode requested_mode;
+
+        /* what the plan was built for */
+        uint16_t w, h, line_pitch, x_offset, y_offset;
+        enum pixel_format pix_fmt;
+        enum picture_field field;
+        std::vector<struct digit> layout;
+
+        /* how luma is found in each pixel */
+        unsigned int stride;
+        bool estimate_from_rgb;
+
+        std::vector<struct run> runs;
+        /* index one past the last run of each segment */
+        std::vector<uint32_t> seg_end;
+        std::vector<uint32_t> seg_area;
+
+        /* the summed-area table alternative */
+        bool use_integral;
+        uint16_t bbox_x, bbox_y, bbox_w, bbox_h;
+        std::vector<struct corners> seg_corners;
+        IntegralImage integral;
+};
+
+/* what decode_segments returns for a digit with no segments lit */
+#define DIGIT_BLANK 10
+
+/* damaged reads within this many segments of a digit are accepted */
+#define MAX_SEGMENT_ERRORS 1
+
+struct segment_decode {
+    /* 0-9, DIGIT_BLANK, or -1 if two digits are equally near */
+    int8_t value;
+    /* number of segments that disagree with value's pattern */
+    uint8_t distance;
+};
+
+/* 
+ * Decode a digit from its lit segments (bit n = segment n) by table
+ * lookup. Never fails: a damaged read gives the nearest digit and how
+ * far off it was.
+ */
+const struct segment_decode *decode_segments(uint8_t mask);
+
+/* the reverse: segments lit for a digit 0-9 (none for DIGIT_BLANK) */
+uint8_t digit_segments(int digit);
+
+struct digit_read {
+    /* 0-9, DIGIT_BLANK, or -1 if unreadable */
+    int8_t value;
+    /* segments that were off from value's pattern */
+    uint8_t distance;
+    /* 255 for a clean read, less for each bad segment, 0 if unreadable */
+    uint8_t confidence;
+};
+
+/* field values that could not be read */
+#define FIELD_INVALID (-1)
+
+/* flags of a scoreboard_state (sent in v2 packets) */
+/* values were extrapolated by a ClockPredictor, not read from a frame */
+#define STATE_PREDICTED         0x01
+/* a clock field started running */
+#define STATE_CLOCK_STARTED     0x02
+/* a clock field stopped */
+#define STATE_CLOCK_STOPPED     0x04
+/* a clock field jumped to a value it couldn't have run to (a reset) */
+#define STATE_CLOCK_JUMPED      0x08
+
+/* everything decoded from one frame */
+struct scoreboard_state {
+    /* which capture source it came from */
+    uint16_t source_id;
+    /* counts the states sent from a source, for spotting lost packets */
+    uint32_t sequence;
+    /* frame capture time and when decoding finished (monotonic ns) */
+    uint64_t capture_time;
+    uint64_t decode_time;
+    /* STATE_*; decode_layout clears them */
+    uint8_t flags;
+
+    /* one per field of the layout, or FIELD_INVALID */
+    std::vector<int32_t> values;
+    /* one per digit of the layout */
+    std::vector<struct digit_read> digits;
+    /* luma sum of each segment's box, 7 per digit */
+    std::vector<uint32_t> sums;
+    /* lit segments of each digit (bit n = segment n) */
+    std::vector<uint8_t> masks;
+};
+
+/* 
+ * Decode every field of the layout from p. All digits are sampled in a
+ * single pass, whatever the number of fields. A field with a digit that
+ * can't be read is FIELD_INVALID; the others are still decoded.
+ *
+ * state carries over from the previous frame. If no segment turned on or
+ * off since then (and the plan wasn't rebuilt), the reads and values are
+ * left as they were and this returns false; otherwise true.
+ *
+ * Segments are lit when their mean luma is over the layout's threshold,
+ * or, given thresholds (kept from frame to frame, like the plan), over
+ * their own adaptive one.
+ */
+bool decode_layout(Picture *p, const Layout *layout, SamplePlan *plan,
+    struct scoreboard_state *state, AdaptiveThreshold *thresholds = NULL);
+
+/* the value of one field, from its digits (digit 0 rightmost) */
+int32_t interpret_field(const struct field *f, const struct digit_read *reads);
+
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * destination.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "destination.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <stdexcept>
+#include <string>
+
+/* the most targets handed to one sendmmsg call */
+#define MAX_BATCH 64
+
+NetworkDestination::NetworkDestination(enum packet_format format) {
+    this->format = format;
+    inet_fd = unix_fd = -1;
+    n_dropped = 0;
+}
+
+NetworkDestination::~NetworkDestination( ) {
+    if (inet_fd != -1) {
+        close(inet_fd);
+    }
+    if (unix_fd != -1) {
+        close(unix_fd);
+    }
+}
+
+void NetworkDestination::add_udp_target(const char *host_port) {
+    struct addrinfo hints, *res;
+    struct sockaddr_storage addr;
+    std::string host;
+    const char *colon = strrchr(host_port, ':');
+
+    if (colon == NULL || colon == host_port) {
+        throw std::runtime_error("UDP targets look like host:port");
+    }
+    host.assign(host_port, colon - host_port);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str( ), colon + 1, &hints, &res) != 0) {
+        throw std::runtime_error("could not resolve UDP target");
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    inet_lengths.push_back(res->ai_addrlen);
+    inet_targets.push_back(addr);
+    freeaddrinfo(res);
+
+    if (inet_fd == -1) {
+        /* Winsock crap goes here! */
+        inet_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (inet_fd == -1) {
+            throw std::runtime_error("socket() failed");
+        }
+    }
+}
+
+void NetworkDestination::add_unix_target(const char *path) {
+    struct sockaddr_storage addr;
+    struct sockaddr_un *sun = (struct sockaddr_un *)&addr;
+
+    if (strlen(path) >= sizeof(sun->sun_path)) {
+        throw std::runtime_error("Unix socket path is too long");
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, path);
+    unix_targets.push_back(addr);
+    unix_lengths.push_back(sizeof(struct sockaddr_un));
+
+    if (unix_fd == -1) {
+        unix_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (unix_fd == -1) {
+            throw std::runtime_error("socket() failed");
+        }
+    }
+}
+
+void NetworkDestination::send_batch(int fd, 
+        std::vector<struct sockaddr_storage> &targets,
+        std::vector<socklen_t> &lengths) {
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iov;
+    unsigned int i, n, first = 0;
+    int sent;
+
+    iov.iov_base = packet.data( );
+    iov.iov_len = packet.size( );
+
+    while (first < targets.size( )) {
+        n = targets.size( ) - first;
+        if (n > MAX_BATCH) {
+            n = MAX_BATCH;
+        }
+
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (i = 0; i < n; ++i) {
+            msgs[i].msg_hdr.msg_name = &targets[first + i];
+            msgs[i].msg_hdr.msg_namelen = lengths[first + i];
+            msgs[i].msg_hdr.msg_iov = &iov;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        sent = sendmmsg(fd, msgs, n, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* the first target refused it (full, or nobody listening) */
+            sent = 0;
+        }
+
+        first += sent;
+        if ((unsigned int)sent < n) {
+            /* skip the one that failed, and go on with the rest */
+            n_dropped++;
+            first++;
+        }
+    }
+}
+
+void NetworkDestination::send(const Layout *layout, 
+        const struct scoreboard_state *state) {
+    (void) layout;
+
+    /* one encoding for every target */
+    encode_packet(format, state, &packet);
+
+    if (!inet_targets.empty( )) {
+        send_batch(inet_fd, inet_targets, inet_lengths);
+    }
+    if (!unix_targets.empty( )) {
+        send_batch(unix_fd, unix_targets, unix_lengths);
+    }
+}
+
+FileDestination::FileDestination(const char *filename) {
+    if (strcmp(filename, "-") == 0) {
+        out = stdout;
+    } else {
+        out = fopen(filename, "a");
+        if (out == NULL) {
+            throw std::runtime_error("could not open log file");
+        }
+    }
+
+    /* whole lines at a time, so a reader never sees half a state */
+    setvbuf(out, NULL, _IOLBF, 0);
+}
+
+FileDestination::~FileDestination( ) {
+    if (out != stdout) {
+        fclose(out);
+    }
+}
+
+void FileDestination::send(const Layout *layout, 
+        const struct scoreboard_state *state) {
+    fprintf(out, "%llu %llu %u %u %02x: ", 
+        (unsigned long long)state->capture_time,
+        (unsigned long long)state->decode_time,
+        state->source_id, state->sequence, state->flags);
+    print_state(out, layout, state);
+}
+
+ShmDestination::ShmDestination(const char *name) {
+    void *addr;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("could not create shared memory segment");
+    }
+
+    if (ftruncate(fd, sizeof(struct shm_scoreboard)) != 0) {
+        close(fd);
+        throw std::runtime_error("could not size shared memory segment");
+    }
+
+    addr = mmap(NULL, sizeof(struct shm_scoreboard), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("could not map shared memory segment");
+    }
+
+    /* start over: readers see "nothing published" until the first send */
+    sb = (struct shm_scoreboard *)addr;
+    __atomic_store_n(&sb->seq, 0, __ATOMIC_RELEASE);
+    sb->version = SHM_SCOREBOARD_VERSION;
+    sb->magic = SHM_SCOREBOARD_MAGIC;
+}
+
+ShmDestination::~ShmDestination( ) {
+    munmap(sb, sizeof(struct shm_scoreboard));
+}
+
+void ShmDestination::send(const Layout *layout, 
+        const struct scoreboard_state *state) {
+    struct shm_scoreboard_state *out = &sb->state;
+    uint32_t seq = sb->seq, next;
+    unsigned int i, n_fields, n_digits;
+
+    (void) layout;
+
+    n_fields = state->values.size( );
+    n_fields = n_fields > SHM_MAX_FIELDS ? SHM_MAX_FIELDS : n_fields;
+    n_digits = state->digits.size( );
+    n_digits = n_digits > SHM_MAX_DIGITS ? SHM_MAX_DIGITS : n_digits;
+
+    /* odd: readers keep away until it's even again */
+    __atomic_store_n(&sb->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    out->source_id = state->source_id;
+    out->n_fields = n_fields;
+    out->n_digits = n_digits;
+    out->flags = state->flags;
+    out->sequence = state->sequence;
+    out->capture_time = state->capture_time;
+    out->decode_time = state->decode_time;
+    for (i = 0; i < n_fields; ++i) {
+        out->values[i] = state->values[i];
+    }
+    for (i = 0; i < n_digits; ++i) {
+        out->confidence[i] = state->digits[i].confidence;
+    }
+
+    /* 0 means nothing was ever published, so wrap past it */
+    next = seq + 2;
+    if (next == 0) {
+        next = 2;
+    }
+    __atomic_store_n(&sb->seq, next, __ATOMIC_RELEASE);
+}
+
+MultiDestination::~MultiDestination( ) {
+    unsigned int i;
+
+    for (i = 0; i < dests.size( ); ++i) {
+        delete dests[i];
+    }
+}
+
+void MultiDestination::send(const Layout *layout, 
+        const struct scoreboard_state *state) {
+    unsigned int i;
+
+    for (i = 0; i < dests.size( ); ++i) {
+        dests[i]->send(layout, state);
+    }
+}
+
+Destination *open_destinations(const std::vector<const char *> &sinks,
+        enum packet_format format) {
+    MultiDestination *multi = new MultiDestination( );
+    NetworkDestination *net = NULL;
+    struct in_addr group;
+    const char *spec, *colon;
+    std::string kind, host;
+    unsigned int i;
+
+    try {
+        for (i = 0; i < sinks.size( ); ++i) {
+            spec = sinks[i];
+            colon = strchr(spec, ':');
+            if (colon == NULL) {
+                throw std::runtime_error("sinks look like kind:address");
+            }
+            kind.assign(spec, colon - spec);
+
+            if (kind == "file") {
+                multi->add(new FileDestination(colon + 1));
+                continue;
+            }
+
+            if (kind == "shm") {
+                multi->add(new ShmDestination(colon + 1));
+                continue;
+            }
+
+            if (kind != "mcast" && kind != "udp" && kind != "unix") {
+                throw std::runtime_error("unknown sink (mcast, udp, unix, file or shm)");
+            }
+
+            if (net == NULL) {
+                net = new NetworkDestination(format);
+                multi->add(net);
+            }
+
+            if (kind == "unix") {
+                net->add_unix_target(colon + 1);
+                continue;
+            }
+
+            if (kind == "mcast") {
+                host.assign(colon + 1);
+                host.resize(host.find(':') == std::string::npos 
+                    ? host.size( ) : host.find(':'));
+                if (inet_aton(host.c_str( ), &group) == 0 
+                        || !IN_MULTICAST(ntohl(group.s_addr))) {
+                    throw std::runtime_error("mcast sink needs a multicast group address");
+                }
+            }
+
+            net->add_udp_target(colon + 1);
+        }
+    } catch (...) {
+        delete multi;
+        throw;
+    }
+
+    return multi;
+}
+
+void print_state(FILE *out, const Layout *layout,
+        const struct scoreboard_state *state) {
+    unsigned int i;
+    int32_t v;
+
+    for (i = 0; i < layout->fields.size( ); ++i) {
+        v = state->values[i];
+        fprintf(out, "%s%s = ", i ? ", " : "", layout->fields[i].name.c_str( ));
+        if (v == FIELD_INVALID) {
+            fprintf(out, "?");
+        } else if (layout->fields[i].rule != FIELD_CLOCK) {
+            fprintf(out, "%d", v);
+        } else if (v >= 600) {
+            fprintf(out, "%d:%02d", v / 600, (v / 10) % 60);
+        } else {
+            fprintf(out, ":%02d.%d", v / 10, v % 10);
+        }
+    }
+    fprintf(out, "\n");
+}
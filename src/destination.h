@@ -0,0 +1,137 @@
+#ifndef _DESTINATION_H
+#define _DESTINATION_H
+
+/*
+ * destination.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "decoder.h"
+#include "packet.h"
+#include "shm_scoreboard.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+/* somewhere decoded scoreboard data goes */
+class Destination {
+    public:
+        Destination( ) { }
+        virtual ~Destination( ) { }
+        /* called with every field of one frame at once */
+        virtual void send(const Layout *layout, 
+                const struct scoreboard_state *state) { 
+            (void) layout;
+            (void) state;
+        }
+};
+
+/*
+ * Datagram sockets: any number of UDP (unicast or multicast) and Unix
+ * domain targets, all sent the same packet. Each state is encoded once,
+ * then goes out in one sendmmsg call per address family. The sockets
+ * are non-blocking; if a target can't take a packet right away, that
+ * packet is dropped for it (and counted) rather than waited on.
+ */
+class NetworkDestination : public Destination {
+    public:
+        NetworkDestination(enum packet_format format = PACKET_LEGACY);
+        virtual ~NetworkDestination( );
+
+        /* "239.160.181.93:30004"; multicast groups need nothing special */
+        void add_udp_target(const char *host_port);
+        /* path of a bound AF_UNIX SOCK_DGRAM socket */
+        void add_unix_target(const char *path);
+
+        virtual void send(const Layout *layout, 
+                const struct scoreboard_state *state);
+
+        uint64_t dropped(void) const { return n_dropped; }
+
+    protected:
+        void send_batch(int fd, std::vector<struct sockaddr_storage> &targets,
+            std::vector<socklen_t> &lengths);
+
+        int inet_fd, unix_fd;
+        std::vector<struct sockaddr_storage> inet_targets, unix_targets;
+        std::vector<socklen_t> inet_lengths, unix_lengths;
+        enum packet_format format;
+        std::vector<uint8_t> packet;
+        uint64_t n_dropped;
+};
+
+/* a line of text per state (timestamps, sequence, flags and fields) */
+class FileDestination : public Destination {
+    public:
+        /* appends; "-" is standard output */
+        FileDestination(const char *filename);
+        virtual ~FileDestination( );
+
+        virtual void send(const Layout *layout, 
+                const struct scoreboard_state *state);
+
+    protected:
+        FILE *out;
+};
+
+/*
+ * The latest state in a POSIX shared memory segment, for readers on the
+ * same host; see shm_scoreboard.h. There must be only one writer per
+ * segment. The segment is left in place on exit, holding the last state.
+ */
+class ShmDestination : public Destination {
+    public:
+        /* name as for shm_open, e.g. "/seven_seg" */
+        ShmDestination(const char *name);
+        virtual ~ShmDestination( );
+
+        virtual void send(const Layout *layout, 
+                const struct scoreboard_state *state);
+
+    protected:
+        struct shm_scoreboard *sb;
+};
+
+/* sends everything on to each of a list of destinations, which it owns */
+class MultiDestination : public Destination {
+    public:
+        MultiDestination( ) { }
+        virtual ~MultiDestination( );
+
+        void add(Destination *dest) { dests.push_back(dest); }
+
+        virtual void send(const Layout *layout, 
+                const struct scoreboard_state *state);
+
+    protected:
+        std::vector<Destination *> dests;
+};
+
+/* the original, hard-coded multicast group */
+#define DEFAULT_SINK "mcast:239.160.181.93:30004"
+
+/*
+ * Build the destination for a list of sinks, each one of
+ *   mcast:GROUP:PORT
+ *   udp:HOST:PORT
+ *   unix:PATH
+ *   file:PATH
+ *   shm:NAME
+ * All network sinks share one NetworkDestination. Throws
+ * std::runtime_error on a bad sink.
+ */
+Destination *open_destinations(const std::vector<const char *> &sinks,
+    enum packet_format format);
+
+/* print the decoded fields on one line, clocks as M:SS or :SS.T */
+void print_state(FILE *out, const Layout *layout,
+    const struct scoreboard_state *state);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * headless.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+/*
+ * seven_seg_headless: decode with a layout saved by the interactive
+ * program, with no display at all. Nothing here touches SDL, so this can
+ * run (and be built) on a machine that doesn't have it.
+ *
+ * Any number of sources can be decoded at once, each with its own
+ * layout file, by one MultiPipeline.
+ */
+
+#include "picture.h"
+#include "capture.h"
+#include "destination.h"
+#include "options.h"
+#include "multi_pipeline.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t timing_requested = 0;
+
+static void request_stop(int sig) {
+    (void) sig;
+    stop_requested = 1;
+}
+
+static void request_timing(int sig) {
+    (void) sig;
+    timing_requested = 1;
+}
+
+int main(int argc, char **argv) {
+    struct options opts;
+    Layout layout;
+    std::vector<CaptureSource *> sources;
+    Destination *dest = NULL;
+    MultiPipeline *pipeline;
+    struct picture_pool_stats pool;
+    uint64_t next_timing;
+    unsigned int i;
+
+    if (!parse_options(argc, argv, &opts)) {
+        return 1;
+    }
+
+    if (opts.layout_files.empty( )) {
+        fprintf(stderr, "headless mode needs a layout file (-f), saved from "
+            "setup mode of the interactive program\n");
+        return 1;
+    }
+
+    try {
+        dest = open_destinations(opts.sinks, opts.format);
+        pipeline = new MultiPipeline(dest, opts.threads);
+
+        for (i = 0; i < opts.sources.size( ); ++i) {
+            /* one layout file for everything, or one each */
+            layout.load(opts.layout_files[
+                opts.layout_files.size( ) == 1 ? 0 : i]);
+            sources.push_back(open_capture_source(opts.sources[i]));
+            pipeline->add_feed(sources[i], &layout, opts.source_id + i);
+        }
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what( ));
+        return 1;
+    }
+
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    signal(SIGUSR1, request_timing);
+
+    pipeline->set_keepalive(opts.keepalive);
+    pipeline->set_publish_rate(opts.publish_rate);
+    pipeline->set_field_order(opts.field_order);
+    pipeline->set_debounce(opts.debounce);
+    pipeline->set_adaptive(opts.adaptive);
+    pipeline->start( );
+
+    /* the capture threads and the work pool do all the work */
+    next_timing = monotonic_ns( ) + opts.stats_interval * 1000000000ULL;
+    while (!stop_requested && !pipeline->finished( )) {
+        usleep(100000);
+
+        if (timing_requested || (opts.stats_interval != 0 
+                && monotonic_ns( ) >= next_timing)) {
+            timing_requested = 0;
+            next_timing = monotonic_ns( ) + opts.stats_interval * 1000000000ULL;
+            pipeline->print_timing(stderr);
+        }
+    }
+
+    pipeline->stop( );
+
+    Picture::pool_stats(&pool);
+    fprintf(stderr, "picture pool: %llu hits, %llu misses, %llu discards\n",
+        (unsigned long long)pool.hits, (unsigned long long)pool.misses,
+        (unsigned long long)pool.discards);
+    pipeline->print_stats(stderr);
+    pipeline->print_timing(stderr);
+
+    delete pipeline;
+    delete dest;
+    for (i = 0; i < sources.size( ); ++i) {
+        delete sources[i];
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * histogram.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "histogram.h"
+
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram( ) {
+    unsigned int i;
+
+    for (i = 0; i < N_BUCKETS; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    n.store(0);
+    sum_ns.store(0);
+    max_ns.store(0);
+}
+
+/*
+ * Values below HISTOGRAM_SUB_BUCKETS get a bucket each. Above that, the
+ * bucket is the position of the top bit and the HISTOGRAM_SUB_BITS bits
+ * below it.
+ */
+unsigned int LatencyHistogram::bucket_of(uint64_t ns) {
+    unsigned int top;
+
+    if (ns < HISTOGRAM_SUB_BUCKETS) {
+        return ns;
+    }
+
+    if (ns >> HISTOGRAM_MAX_BITS) {
+        ns = (1ULL << HISTOGRAM_MAX_BITS) - 1;
+    }
+
+    top = 63 - __builtin_clzll(ns);
+    return (top - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS
+        + ((ns >> (top - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* the middle of bucket b */
+uint64_t LatencyHistogram::bucket_value(unsigned int b) {
+    unsigned int shift;
+    uint64_t base;
+
+    if (b < HISTOGRAM_SUB_BUCKETS) {
+        return b;
+    }
+
+    shift = b / HISTOGRAM_SUB_BUCKETS - 1;
+    base = (uint64_t)(HISTOGRAM_SUB_BUCKETS + b % HISTOGRAM_SUB_BUCKETS) << shift;
+    return base + ((1ULL << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    uint64_t old_max = max_ns.load(std::memory_order_relaxed);
+
+    buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    n.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    while (ns > old_max && !max_ns.compare_exchange_weak(old_max, ns,
+            std::memory_order_relaxed)) {
+        /* old_max has been reloaded; try again */
+    }
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    uint64_t total = count( ), seen = 0, want;
+    unsigned int i;
+
+    if (total == 0) {
+        return 0;
+    }
+
+    want = (uint64_t)(q * total);
+    if (want >= total) {
+        want = total - 1;
+    }
+
+    for (i = 0; i < N_BUCKETS; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > want) {
+            /* the middle of the top bucket can be past the real maximum */
+            return std::min(bucket_value(i), max( ));
+        }
+    }
+
+    return max( );
+}
+
+void LatencyHistogram::print(FILE *out, const char *name) const {
+    uint64_t total = count( );
+
+    if (total == 0) {
+        fprintf(out, "%-14s no samples\n", name);
+        return;
+    }
+
+    fprintf(out, "%-14s n=%-9llu mean %9.1f  p50 %9.1f  p90 %9.1f  "
+        "p99 %9.1f  p99.9 %9.1f  max %9.1f us\n", name,
+        (unsigned long long)total, sum_ns.load( ) / 1000.0 / total,
+        quantile(0.5) / 1000.0, quantile(0.9) / 1000.0,
+        quantile(0.99) / 1000.0, quantile(0.999) / 1000.0, max( ) / 1000.0);
+}
@@ -0,0 +1,55 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+/*
+ * histogram.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * Latency histogram in the style of HdrHistogram: each power of two is
+ * split into HISTOGRAM_SUB_BUCKETS equal buckets, so every value is kept
+ * to within about 3% whatever its size, in a fixed amount of memory.
+ * record( ) is a couple of relaxed atomic adds, so any thread can call it
+ * on the hot path, and print( ) can run at the same time from another.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+/* values up to 2^40 ns (about 18 minutes); anything longer is clamped */
+#define HISTOGRAM_MAX_BITS 40
+
+class LatencyHistogram {
+    public:
+        LatencyHistogram( );
+
+        void record(uint64_t ns);
+
+        /* the value at quantile q (0-1), to within a bucket */
+        uint64_t quantile(double q) const;
+        uint64_t count(void) const { return n.load(std::memory_order_relaxed); }
+        uint64_t max(void) const { return max_ns.load(std::memory_order_relaxed); }
+
+        /* one line: count, mean, p50/p90/p99/p99.9 and max, in us */
+        void print(FILE *out, const char *name) const;
+
+    protected:
+        static unsigned int bucket_of(uint64_t ns);
+        static uint64_t bucket_value(unsigned int b);
+
+        enum { N_BUCKETS = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) 
+            * HISTOGRAM_SUB_BUCKETS };
+
+        std::atomic<uint64_t> buckets[N_BUCKETS];
+        std::atomic<uint64_t> n, sum_ns, max_ns;
+};
+
+#endif
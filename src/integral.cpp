@@ -0,0 +1,111 @@
+/*
+ * integral.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "integral.h"
+
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * out[i] = above[i] + luma[0] + ... + luma[i - 1], for i in 1..n
+ * (out[0] and above[0] are the zero column and are left alone)
+ */
+static void integral_row(const uint32_t *above, const uint8_t *luma,
+        uint32_t *out, unsigned int n) {
+    uint32_t run = 0;
+    unsigned int i = 0;
+
+#ifdef __SSE2__
+    /*
+     * prefix sums four lanes at a time: shift-and-add within the vector,
+     * then add in everything to the left of it
+     */
+    __m128i carry = _mm_setzero_si128( );
+    const __m128i zero = _mm_setzero_si128( );
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(luma + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i v[4];
+        int k;
+
+        v[0] = _mm_unpacklo_epi16(lo, zero);
+        v[1] = _mm_unpackhi_epi16(lo, zero);
+        v[2] = _mm_unpacklo_epi16(hi, zero);
+        v[3] = _mm_unpackhi_epi16(hi, zero);
+
+        for (k = 0; k < 4; ++k) {
+            v[k] = _mm_add_epi32(v[k], _mm_slli_si128(v[k], 4));
+            v[k] = _mm_add_epi32(v[k], _mm_slli_si128(v[k], 8));
+            v[k] = _mm_add_epi32(v[k], carry);
+            carry = _mm_shuffle_epi32(v[k], _MM_SHUFFLE(3, 3, 3, 3));
+
+            _mm_storeu_si128((__m128i *)(out + 1 + i + 4 * k), _mm_add_epi32(v[k],
+                _mm_loadu_si128((const __m128i *)(above + 1 + i + 4 * k))));
+        }
+    }
+
+    run = _mm_cvtsi128_si32(carry);
+#endif
+
+    for (; i < n; ++i) {
+        run += luma[i];
+        out[i + 1] = above[i + 1] + run;
+    }
+}
+
+IntegralImage::IntegralImage( ) {
+    w = h = 0;
+    table.assign(1, 0);
+}
+
+void IntegralImage::build(Picture *p, uint16_t x, uint16_t y,
+        uint16_t w, uint16_t h) {
+    Picture *area, *luma;
+
+    area = Picture::view(p, x, y, w, h);
+    if (area->w != w || area->h != h) {
+        Picture::free(area);
+        throw std::runtime_error("IntegralImage: area does not fit the picture");
+    }
+
+    /* the Y8 kernels do the luma extraction (and RGB estimate) for us */
+    if (area->pix_fmt == A8) {
+        build_from_luma(area);
+    } else {
+        luma = area->convert_to_format(A8);
+        build_from_luma(luma);
+        Picture::free(luma);
+    }
+
+    Picture::free(area);
+}
+
+void IntegralImage::build_from_luma(Picture *luma) {
+    unsigned int col, row;
+
+    w = luma->w;
+    h = luma->h;
+    /* resize only grows the buffer the first time a size is seen */
+    table.resize((w + 1) * (h + 1));
+
+    for (col = 0; col <= w; ++col) {
+        table[col] = 0;
+    }
+
+    for (row = 0; row < h; ++row) {
+        table[(row + 1) * (w + 1)] = 0;
+        integral_row(&table[row * (w + 1)], luma->scanline(row),
+            &table[(row + 1) * (w + 1)], w);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _INTEGRAL_H
+#define _INTEGRAL_H
+
+/*
+ * integral.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "picture.h"
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Summed-area table of the luma of (part of) a picture. Once built, the
+ * luma sum over any rectangle inside it costs four lookups, whatever
+ * the rectangle's size.
+ *
+ * The table is (w + 1) x (h + 1) with a zero first row and column, so the
+ * sum over columns [x0, x1) and rows [y0, y1) of the area is
+ *
+ *   t[y1][x1] - t[y0][x1] - t[y1][x0] + t[y0][x0]
+ *
+ * where t[y][x] is entry y * pitch( ) + x of data( ).
+ */
+class IntegralImage {
+    public:
+        IntegralImage( );
+
+        /*
+         * Build the table over the w x h area at (x, y) of p (picture
+         * coordinates). For UYVY8 and YUYV8, x and w have to be even.
+         */
+        void build(Picture *p, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+        const uint32_t *data(void) const { return &table[0]; }
+        unsigned int pitch(void) const { return w + 1; }
+
+    protected:
+        void build_from_luma(Picture *luma);
+
+        unsigned int w, h;
+        std::vector<uint32_t> table;
+};
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ * layout.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "layout.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+static const struct {
+    const char *name;
+    enum field_rule rule;
+} rule_names[] = {
+    { "clock", FIELD_CLOCK },
+    { "int", FIELD_INTEGER },
+};
+
+#define N_RULES (sizeof(rule_names) / sizeof(rule_names[0]))
+
+/*
+ * Layout file format, one record per line:
+ *
+ *   seven_seg layout 2
+ *   frame W H                       (size of the frames it was set up on)
+ *   threshold T                     (mean luma of a lit segment)
+ *   field NAME RULE DIGITS          (once per field, in order)
+ *   digit X Y W H X Y W H ...       (once per digit: 7 segments' boxes)
+ *
+ * Version 1 files have no frame or threshold lines.
+ */
+#define LAYOUT_MAGIC "seven_seg layout"
+#define LAYOUT_VERSION 2
+
+/* whether a field name can be written to (and read back from) a file */
+static bool valid_field_name(const std::string &name) {
+    unsigned int i;
+
+    if (name.empty( ) || name.size( ) > MAX_FIELD_NAME) {
+        return false;
+    }
+    for (i = 0; i < name.size( ); ++i) {
+        if (isspace((unsigned char)name[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Layout::Layout( ) {
+    threshold = DEFAULT_THRESHOLD;
+    frame_w = frame_h = 0;
+}
+
+unsigned int Layout::add_field(const char *name, enum field_rule rule,
+        unsigned int n_digits) {
+    struct field f;
+    struct digit blank;
+
+    if (n_digits == 0 || n_digits > MAX_FIELD_DIGITS) {
+        throw std::runtime_error("Layout: bad number of digits in field");
+    }
+
+    f.name = name;
+    if (!valid_field_name(f.name)) {
+        throw std::runtime_error("Layout: field names must be 1-63 "
+            "characters, with no spaces");
+    }
+    f.rule = rule;
+    f.first_digit = digits.size( );
+    f.n_digits = n_digits;
+    fields.push_back(f);
+
+    memset(&blank, 0, sizeof(blank));
+    digits.insert(digits.end( ), n_digits, blank);
+
+    return fields.size( ) - 1;
+}
+
+void Layout::clear(void) {
+    fields.clear( );
+    digits.clear( );
+}
+
+unsigned int Layout::field_of(unsigned int d) const {
+    unsigned int i;
+
+    for (i = 0; i < fields.size( ); ++i) {
+        if (d < fields[i].first_digit + fields[i].n_digits) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Layout: digit is not in any field");
+}
+
+const char *Layout::rule_name(enum field_rule rule) {
+    unsigned int i;
+
+    for (i = 0; i < N_RULES; ++i) {
+        if (rule_names[i].rule == rule) {
+            return rule_names[i].name;
+        }
+    }
+
+    return "unknown";
+}
+
+void Layout::parse(const char *spec) {
+    std::string item, name, rule;
+    const char *end, *colon1, *colon2;
+    unsigned int i;
+    long n;
+    char *n_end;
+    bool found;
+
+    clear( );
+
+    while (*spec != '\0') {
+        end = strchr(spec, ',');
+        if (end == NULL) {
+            end = spec + strlen(spec);
+        }
+        item.assign(spec, end - spec);
+        spec = (*end == ',') ? end + 1 : end;
+
+        colon1 = strchr(item.c_str( ), ':');
+        colon2 = colon1 ? strchr(colon1 + 1, ':') : NULL;
+        if (colon2 == NULL || colon1 == item.c_str( )) {
+            throw std::runtime_error("Layout: fields look like name:rule:digits");
+        }
+
+        name.assign(item.c_str( ), colon1 - item.c_str( ));
+        rule.assign(colon1 + 1, colon2 - colon1 - 1);
+        n = strtol(colon2 + 1, &n_end, 10);
+        if (*n_end != '\0' || n <= 0 || n > MAX_FIELD_DIGITS) {
+            throw std::runtime_error("Layout: bad number of digits in field");
+        }
+
+        found = false;
+        for (i = 0; i < N_RULES; ++i) {
+            if (rule == rule_names[i].name) {
+                add_field(name.c_str( ), rule_names[i].rule, n);
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            throw std::runtime_error("Layout: unknown field rule");
+        }
+    }
+
+    if (fields.empty( )) {
+        throw std::runtime_error("Layout: no fields");
+    }
+}
+
+void Layout::save(const char *filename) const {
+    std::string temp = std::string(filename) + ".tmp";
+    FILE *out;
+    unsigned int i, j;
+    const struct digit *d;
+    bool ok;
+
+    for (i = 0; i < fields.size( ); ++i) {
+        if (!valid_field_name(fields[i].name)) {
+            throw std::runtime_error("Layout: a field name can't be saved");
+        }
+    }
+
+    out = fopen(temp.c_str( ), "w");
+    if (out == NULL) {
+        throw std::runtime_error("Layout: could not open file for writing");
+    }
+
+    fprintf(out, "%s %d\n", LAYOUT_MAGIC, LAYOUT_VERSION);
+    fprintf(out, "frame %u %u\n", frame_w, frame_h);
+    fprintf(out, "threshold %u\n", threshold);
+
+    for (i = 0; i < fields.size( ); ++i) {
+        fprintf(out, "field %s %s %u\n", fields[i].name.c_str( ),
+            rule_name(fields[i].rule), fields[i].n_digits);
+    }
+
+    for (i = 0; i < digits.size( ); ++i) {
+        d = &digits[i];
+        fprintf(out, "digit");
+        for (j = 0; j < 7; ++j) {
+            fprintf(out, " %u %u %u %u", d->segment_pos[j].x, 
+                d->segment_pos[j].y, d->segment_size[j].w, 
+                d->segment_size[j].h);
+        }
+        fprintf(out, "\n");
+    }
+
+    /* all on disk before it replaces the old file */
+    ok = fflush(out) == 0 && !ferror(out) && fsync(fileno(out)) == 0;
+    if (fclose(out) != 0 || !ok || rename(temp.c_str( ), filename) != 0) {
+        unlink(temp.c_str( ));
+        throw std::runtime_error("Layout: error writing file");
+    }
+}
+
+/* read the 28 numbers of a digit line into d */
+static bool parse_digit(const char *line, struct digit *d) {
+    unsigned long v[28];
+    char *end;
+    unsigned int i;
+
+    for (i = 0; i < 28; ++i) {
+        v[i] = strtoul(line, &end, 10);
+        if (end == line || v[i] > 0xffff || (i % 4 >= 2 && v[i] > 0xff)) {
+            return false;
+        }
+        line = end;
+    }
+
+    for (i = 0; i < 7; ++i) {
+        d->segment_pos[i].x = v[4 * i];
+        d->segment_pos[i].y = v[4 * i + 1];
+        d->segment_size[i].w = v[4 * i + 2];
+        d->segment_size[i].h = v[4 * i + 3];
+    }
+
+    return true;
+}
+
+void Layout::load(const char *filename) {
+    FILE *in;
+    char line[512], name[64], rule[16];
+    Layout loaded;
+    unsigned int n, i, w, h, next_digit = 0;
+    int version;
+    bool found;
+
+    in = fopen(filename, "r");
+    if (in == NULL) {
+        throw std::runtime_error("Layout: could not open file");
+    }
+
+    try {
+        if (fgets(line, sizeof(line), in) == NULL 
+                || sscanf(line, LAYOUT_MAGIC " %d", &version) != 1) {
+            throw std::runtime_error("Layout: not a layout file");
+        }
+
+        if (version < 1 || version > LAYOUT_VERSION) {
+            throw std::runtime_error("Layout: unsupported layout file version");
+        }
+
+        while (fgets(line, sizeof(line), in) != NULL) {
+            if (version >= 2 && sscanf(line, "frame %u %u", &w, &h) == 2
+                    && w <= 0xffff && h <= 0xffff) {
+                loaded.frame_w = w;
+                loaded.frame_h = h;
+            } else if (version >= 2 && sscanf(line, "threshold %u", &n) == 1
+                    && n <= 255) {
+                loaded.threshold = n;
+            } else if (sscanf(line, "field %63s %15s %u", name, rule, &n) == 3) {
+                found = false;
+                for (i = 0; i < N_RULES; ++i) {
+                    if (strcmp(rule, rule_names[i].name) == 0) {
+                        loaded.add_field(name, rule_names[i].rule, n);
+                        found = true;
+                    }
+                }
+                if (!found) {
+                    throw std::runtime_error("Layout: unknown field rule in file");
+                }
+            } else if (strncmp(line, "digit ", 6) == 0) {
+                if (next_digit >= loaded.digits.size( ) 
+                        || !parse_digit(line + 6, &loaded.digits[next_digit])) {
+                    throw std::runtime_error("Layout: bad digit in file");
+                }
+                next_digit++;
+            } else if (line[0] != '\n' && line[0] != '#') {
+                throw std::runtime_error("Layout: unrecognized line in file");
+            }
+        }
+
+        if (loaded.fields.empty( ) || next_digit != loaded.digits.size( )) {
+            throw std::runtime_error("Layout: file is incomplete");
+        }
+    } catch (...) {
+        fclose(in);
+        throw;
+    }
+
+    fclose(in);
+    *this = loaded;
+}
@@ -0,0 +1,113 @@
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+
+/*
+ * layout.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct point {
+    uint16_t x, y;
+};
+
+/* width and height of a segment's sample box; 0 means DEFAULT_BOX */
+struct box_size {
+    uint8_t w, h;
+};
+
+#define DEFAULT_BOX 5
+
+/* a segment is lit when its mean luma is above this */
+#define DEFAULT_THRESHOLD 28
+
+struct digit {
+    struct point segment_pos[7];
+    struct box_size segment_size[7];
+};
+
+/* how the digits of a field turn into a number */
+enum field_rule {
+    /* 
+     * Game clock, in tenths of a second. Read as MM:SS, or as :SS.T when
+     * the rightmost digit is blank.
+     */
+    FIELD_CLOCK,
+    /* plain decimal number (score, period, shots...) */
+    FIELD_INTEGER
+};
+
+/* an upper bound, just to catch typos in a spec */
+#define MAX_FIELD_DIGITS 9
+/* longest field name a layout file can hold (names have no spaces) */
+#define MAX_FIELD_NAME 63
+
+struct field {
+    std::string name;
+    enum field_rule rule;
+    /* the field's digits are digits[first_digit ... first_digit + n_digits) */
+    unsigned int first_digit;
+    unsigned int n_digits;
+};
+
+/*
+ * What is on the scoreboard: a list of named fields, each made up of
+ * some digits. Within a field, digit 0 is the rightmost (least
+ * significant) one. The digits of all fields are kept in one array, so
+ * they can all be sampled in a single pass over the frame.
+ */
+class Layout {
+    public:
+        Layout( );
+
+        /* 
+         * append a field with n_digits blank digits; returns its index.
+         * Throws std::runtime_error if the name is empty, too long or
+         * has whitespace in it (it couldn't be saved).
+         */
+        unsigned int add_field(const char *name, enum field_rule rule,
+            unsigned int n_digits);
+
+        /* 
+         * Replace all fields (and digits) with those given in spec, a
+         * comma-separated list of name:rule:digits, e.g.
+         * "clock:clock:4,home:int:2,away:int:2".
+         */
+        void parse(const char *spec);
+
+        void clear(void);
+
+        /* 
+         * Save to or load from a layout file: a small text file holding
+         * the fields, every segment's position and box size, the
+         * threshold and the frame size. Both
+         * throw std::runtime_error on failure; a failed load leaves the
+         * layout as it was. Saving writes a new file and renames it over
+         * the old one, so a crash mid-save leaves the old file intact.
+         */
+        void save(const char *filename) const;
+        void load(const char *filename);
+
+        /* the field digit d belongs to */
+        unsigned int field_of(unsigned int d) const;
+
+        static const char *rule_name(enum field_rule rule);
+
+        std::vector<struct field> fields;
+        std::vector<struct digit> digits;
+
+        /* mean luma above which a segment counts as lit */
+        uint16_t threshold;
+
+        /* size of the frames the layout was set up on (0 = unknown) */
+        uint16_t frame_w, frame_h;
+};
+
+#endif
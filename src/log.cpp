@@ -0,0 +1,12 @@
+/*
+ * log.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "log.h"
+
+int log_level = LOG_WARNING;
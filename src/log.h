@@ -0,0 +1,37 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+/*
+ * log.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <stdio.h>
+
+enum log_level {
+    LOG_ERROR,
+    LOG_WARNING,
+    /* one line per change of the decoded state */
+    LOG_INFO,
+    /* per-frame detail, e.g. digits that could not be read */
+    LOG_DEBUG
+};
+
+/* messages above this level are skipped (default LOG_WARNING) */
+extern int log_level;
+
+/* 
+ * fprintf to stderr if level is enabled; the arguments are not even
+ * evaluated otherwise, so this is cheap to leave in hot paths
+ */
+#define log_msg(level, ...) do { \
+    if ((level) <= log_level) { \
+        fprintf(stderr, __VA_ARGS__); \
+    } \
+} while (0)
+
+#endif
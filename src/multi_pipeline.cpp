@@ -0,0 +1,446 @@
+/*
+ * multi_pipeline.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "multi_pipeline.h"
+#include "log.h"
+#include "timing.h"
+
+#include <unistd.h>
+
+#include <stdexcept>
+
+#define FEED_RING_SIZE 4
+/* decoded states each feed can have waiting for the output thread */
+#define FEED_OUTPUT_RING_SIZE 16
+/* frames a decode task does before letting other feeds have a turn */
+#define FRAMES_PER_TASK 4
+
+MultiPipeline::feed::feed(LatencyHistogram *debounce_time) 
+        : ring(FEED_RING_SIZE), output_ring(FEED_OUTPUT_RING_SIZE), 
+        filter(debounce_time) {
+    source = NULL;
+    source_id = 0;
+    scheduled.store(false);
+    done.store(false);
+    last_timestamp = 0;
+    since_send = 0;
+    unsent = false;
+    sequence = 0;
+    warned_geometry = false;
+
+    n_captured.store(0);
+    n_decoded.store(0);
+    n_unchanged.store(0);
+    n_sent.store(0);
+    n_predicted.store(0);
+}
+
+MultiPipeline::MultiPipeline(Destination *dest, unsigned int threads) 
+        : pool(threads) {
+    this->dest = dest;
+    quit.store(false);
+    keepalive.store(DEFAULT_KEEPALIVE);
+    active.store(0);
+    publish_rate = 0;
+    field_order = PROGRESSIVE;
+    debounce_frames = 1;
+    adaptive = false;
+    started = false;
+}
+
+MultiPipeline::~MultiPipeline( ) {
+    unsigned int i;
+
+    stop( );
+    for (i = 0; i < feeds.size( ); ++i) {
+        delete feeds[i];
+    }
+}
+
+void MultiPipeline::add_feed(CaptureSource *source, const Layout *layout,
+        uint16_t source_id) {
+    struct feed *f;
+
+    if (started) {
+        throw std::runtime_error("MultiPipeline: can't add feeds while running");
+    }
+
+    f = new feed(&debounce_time);
+    f->source = source;
+    f->layout = *layout;
+    f->source_id = source_id;
+    feeds.push_back(f);
+}
+
+void MultiPipeline::start(void) {
+    unsigned int i;
+
+    if (started) {
+        return;
+    }
+
+    quit.store(false);
+    for (i = 0; i < feeds.size( ); ++i) {
+        feeds[i]->filter.set_frames(debounce_frames);
+        feeds[i]->capture_thread = std::thread(&MultiPipeline::capture_main, 
+            this, feeds[i]);
+    }
+    output_thread = std::thread(&MultiPipeline::output_main, this);
+    started = true;
+}
+
+void MultiPipeline::stop(void) {
+    struct captured_frame captured;
+    struct decoded_frame decoded;
+    unsigned int i;
+
+    if (!started) {
+        return;
+    }
+
+    quit.store(true);
+    /* get_frame may be waiting on a source that has gone quiet */
+    for (i = 0; i < feeds.size( ); ++i) {
+        feeds[i]->source->interrupt( );
+    }
+    for (i = 0; i < feeds.size( ); ++i) {
+        feeds[i]->capture_thread.join( );
+    }
+    output_thread.join( );
+
+    /* decode tasks see quit and give up quickly */
+    while (active.load( ) != 0) {
+        usleep(1000);
+    }
+    started = false;
+
+    for (i = 0; i < feeds.size( ); ++i) {
+        while (feeds[i]->ring.pop(&captured)) {
+            feeds[i]->source->release_frame(captured.frame);
+        }
+        while (feeds[i]->output_ring.pop(&decoded)) { }
+    }
+}
+
+bool MultiPipeline::finished(void) {
+    unsigned int i;
+
+    for (i = 0; i < feeds.size( ); ++i) {
+        if (!feeds[i]->done.load( )) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MultiPipeline::capture_main(struct feed *f) {
+    struct captured_frame out;
+    unsigned int tries;
+
+    while (!quit.load( )) {
+        out.frame = f->source->get_frame( );
+        if (out.frame == NULL) {
+            f->done.store(true);
+            break;
+        }
+        out.captured = monotonic_ns( );
+        f->n_captured++;
+
+        if (out.frame->timestamp != 0 && out.frame->timestamp <= out.captured) {
+            capture_time.record(out.captured - out.frame->timestamp);
+        }
+
+        /* the feed's decode task is behind: wait for it */
+        tries = 0;
+        while (!f->ring.push(out)) {
+            if (quit.load( )) {
+                f->source->release_frame(out.frame);
+                return;
+            }
+            if (tries < 64) {
+                std::this_thread::yield( );
+            } else {
+                usleep(200);
+            }
+            tries++;
+        }
+
+        schedule(f);
+    }
+}
+
+void MultiPipeline::schedule(struct feed *f) {
+    /* 
+     * The exchange pairs with the one in decode_feed: either the task
+     * still running sees the frame just pushed, or we start a new one.
+     */
+    if (!f->scheduled.exchange(true, std::memory_order_acq_rel)) {
+        active++;
+        pool.submit([this, f]( ) { decode_feed(f); });
+    }
+}
+
+void MultiPipeline::decode_feed(struct feed *f) {
+    struct captured_frame in;
+    unsigned int n = 0;
+
+    for (;;) {
+        while (n < FRAMES_PER_TASK && f->ring.pop(&in)) {
+            if (quit.load( )) {
+                f->source->release_frame(in.frame);
+            } else {
+                decode_frame(f, &in);
+            }
+            n++;
+        }
+
+        if (n == FRAMES_PER_TASK && !f->ring.empty( ) && !quit.load( )) {
+            /* more to do, but let the other feeds in first */
+            pool.submit_fair([this, f]( ) { decode_feed(f); });
+            return;
+        }
+
+        f->scheduled.exchange(false, std::memory_order_acq_rel);
+        /* a frame may have come in after the ring looked empty */
+        if (f->ring.empty( ) 
+                || f->scheduled.exchange(true, std::memory_order_acq_rel)) {
+            break;
+        }
+        n = 0;
+    }
+
+    active--;
+}
+
+void MultiPipeline::decode_frame(struct feed *f, struct captured_frame *in) {
+    Picture *frame = in->frame, *pictures[2];
+    unsigned int i, n;
+
+    queue_time.record(monotonic_ns( ) - in->captured);
+
+    if (f->layout.frame_w != 0 && !f->warned_geometry
+            && (frame->w != f->layout.frame_w 
+            || frame->h != f->layout.frame_h)) {
+        log_msg(LOG_WARNING, "warning: source %u: layout was set up on "
+            "%ux%u frames, but these are %ux%u\n", f->source_id,
+            f->layout.frame_w, f->layout.frame_h, frame->w, frame->h);
+        f->warned_geometry = true;
+    }
+
+    n = split_frame(frame, field_order, &f->last_timestamp, pictures);
+    for (i = 0; i < n; ++i) {
+        decode_picture(f, pictures[i]);
+        if (pictures[i] != frame) {
+            Picture::free(pictures[i]);
+        }
+    }
+
+    f->source->release_frame(frame);
+}
+
+void MultiPipeline::decode_picture(struct feed *f, Picture *p) {
+    struct decoded_frame out;
+    uint64_t start;
+    bool changed;
+
+    start = monotonic_ns( );
+    out.previous = f->state.capture_time;
+    changed = decode_layout(p, &f->layout, &f->plans[p->field], &f->state,
+        adaptive ? &f->thresholds : NULL);
+    changed = f->filter.apply(&f->layout, &f->state, changed, &out.state);
+    out.decoded = monotonic_ns( );
+
+    sample_time.record(out.state.decode_time - start);
+    decode_time.record(out.decoded - start);
+    f->n_decoded++;
+    f->since_send++;
+
+    if (!changed) {
+        f->n_unchanged++;
+    }
+
+    /* as in Pipeline: a change that can't be passed on now sticks */
+    changed = changed || f->unsent;
+
+    if (changed || (keepalive.load( ) != 0 
+            && f->since_send >= keepalive.load( ))) {
+        out.changed = changed;
+        /* never wait on output: a change goes with the next state instead */
+        if (f->output_ring.push(out)) {
+            f->since_send = 0;
+            f->unsent = false;
+        } else {
+            f->unsent = changed;
+        }
+    }
+}
+
+void MultiPipeline::output_main(void) {
+    uint64_t interval = 0, next_publish = 0, now;
+    unsigned int i, tries = 0;
+    bool sent;
+
+    if (publish_rate != 0) {
+        interval = 1000000000ULL / publish_rate;
+    }
+
+    while (!quit.load( )) {
+        if (interval != 0 && (now = monotonic_ns( )) >= next_publish) {
+            next_publish = now + interval;
+            publish(now);
+        }
+
+        /* a state from each feed in turn, so none waits behind another */
+        sent = false;
+        for (i = 0; i < feeds.size( ); ++i) {
+            if (output(feeds[i])) {
+                sent = true;
+            }
+        }
+
+        if (sent) {
+            tries = 0;
+        } else if (tries < 64) {
+            std::this_thread::yield( );
+            tries++;
+        } else {
+            usleep(200);
+        }
+    }
+}
+
+bool MultiPipeline::output(struct feed *f) {
+    struct decoded_frame in;
+    uint64_t start, end;
+
+    if (!f->output_ring.pop(&in)) {
+        return false;
+    }
+    start = monotonic_ns( );
+    output_queue_time.record(start - in.decoded);
+
+    f->predictor.update(&f->layout, &in.state, in.previous);
+    if (in.changed && log_level >= LOG_INFO) {
+        fprintf(stderr, "%u: ", f->source_id);
+        print_state(stderr, &f->layout, &in.state);
+    }
+
+    in.state.source_id = f->source_id;
+    in.state.sequence = f->sequence++;
+    dest->send(&f->layout, &in.state);
+
+    end = monotonic_ns( );
+    send_time.record(end - start);
+    if (in.state.capture_time != 0 && in.state.capture_time <= end) {
+        total_time.record(end - in.state.capture_time);
+    }
+    f->n_sent++;
+    return true;
+}
+
+void MultiPipeline::publish(uint64_t now) {
+    struct feed *f;
+    unsigned int i;
+
+    for (i = 0; i < feeds.size( ); ++i) {
+        f = feeds[i];
+        if (!f->predictor.predict(now, &f->predicted)) {
+            continue;
+        }
+
+        if (log_level >= LOG_DEBUG) {
+            fprintf(stderr, "%u: predicted: ", f->source_id);
+            print_state(stderr, &f->layout, &f->predicted);
+        }
+        f->predicted.source_id = f->source_id;
+        f->predicted.sequence = f->sequence++;
+        dest->send(&f->layout, &f->predicted);
+        f->n_sent++;
+        f->n_predicted++;
+    }
+}
+
+void MultiPipeline::get_stats(unsigned int feed, struct pipeline_stats *stats) {
+    struct feed *f = feeds[feed];
+
+    stats->captured = f->n_captured.load( );
+    stats->decoded = f->n_decoded.load( );
+    stats->unchanged = f->n_unchanged.load( );
+    stats->sent = f->n_sent.load( );
+    stats->predicted = f->n_predicted.load( );
+    stats->preview_dropped = 0;
+}
+
+void MultiPipeline::get_stats(struct pipeline_stats *stats) {
+    struct pipeline_stats one;
+    unsigned int i;
+
+    stats->captured = 0;
+    stats->decoded = 0;
+    stats->unchanged = 0;
+    stats->sent = 0;
+    stats->predicted = 0;
+    stats->preview_dropped = 0;
+
+    for (i = 0; i < feeds.size( ); ++i) {
+        get_stats(i, &one);
+        stats->captured += one.captured;
+        stats->decoded += one.decoded;
+        stats->unchanged += one.unchanged;
+        stats->sent += one.sent;
+        stats->predicted += one.predicted;
+    }
+}
+
+void MultiPipeline::print_stats(FILE *out) {
+    struct pipeline_stats stats;
+    unsigned int i;
+
+    for (i = 0; i < feeds.size( ); ++i) {
+        get_stats(i, &stats);
+        fprintf(out, "source %u: %llu frames captured, %llu decoded, "
+            "%llu unchanged, %llu sent (%llu predicted)\n", 
+            feeds[i]->source_id, (unsigned long long)stats.captured, 
+            (unsigned long long)stats.decoded,
+            (unsigned long long)stats.unchanged,
+            (unsigned long long)stats.sent,
+            (unsigned long long)stats.predicted);
+    }
+
+    if (debounce_frames > 1) {
+        for (i = 0; i < feeds.size( ); ++i) {
+            fprintf(out, "source %u ", feeds[i]->source_id);
+            print_debounce_stats(out, &feeds[i]->filter);
+        }
+    }
+    if (adaptive) {
+        for (i = 0; i < feeds.size( ); ++i) {
+            fprintf(out, "source %u ", feeds[i]->source_id);
+            print_threshold_stats(out, &feeds[i]->thresholds);
+        }
+    }
+
+    fprintf(out, "work pool: %u threads, %llu tasks, %llu stolen\n",
+        pool.size( ), (unsigned long long)pool.tasks_run( ),
+        (unsigned long long)pool.tasks_stolen( ));
+}
+
+void MultiPipeline::print_timing(FILE *out) {
+    capture_time.print(out, "capture");
+    queue_time.print(out, "queue");
+    sample_time.print(out, "sample");
+    decode_time.print(out, "decode");
+    if (debounce_frames > 1) {
+        debounce_time.print(out, "debounce");
+    }
+    output_queue_time.print(out, "output queue");
+    send_time.print(out, "send");
+    total_time.print(out, "total");
+}
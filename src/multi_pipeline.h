@@ -0,0 +1,182 @@
+#ifndef _MULTI_PIPELINE_H
+#define _MULTI_PIPELINE_H
+
+/*
+ * multi_pipeline.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "capture.h"
+#include "decoder.h"
+#include "destination.h"
+#include "histogram.h"
+#include "pipeline.h"
+#include "predictor.h"
+#include "spsc_ring.h"
+#include "work_pool.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+ * Decodes any number of feeds, each with its own source and layout, into
+ * one Destination. Every state sent is tagged with its feed's source id,
+ * and numbered in its own sequence.
+ *
+ * Each feed has a capture thread, which mostly sits in get_frame, and a
+ * small ring of captured frames. Decoding is done by tasks on a shared
+ * WorkPool (one thread per CPU by default): when a frame arrives at a
+ * feed with no task pending, capture submits one, which decodes until
+ * the ring is empty, or until it has done a few frames, in which case
+ * it requeues itself with submit_fair, behind the tasks already waiting
+ * on its worker, to let other feeds have a turn. So
+ * at most one task works on a feed at a time, frames are decoded in
+ * order, and a feed with no new frames takes no decode time at all.
+ *
+ * Decode tasks never send anything themselves: each feed has a ring of
+ * decoded states, which one output thread takes turns draining into the
+ * Destination (which needn't be thread-safe). A slow sink holds up
+ * output, not decoding; as in Pipeline, a change that finds its feed's
+ * ring full goes out with the next state that fits.
+ *
+ * Each feed has a ClockPredictor, as in Pipeline. With a publish rate,
+ * the output thread also checks them all for predicted clock steps.
+ */
+class MultiPipeline {
+    public:
+        /* 0 threads = one per CPU */
+        MultiPipeline(Destination *dest, unsigned int threads = 0);
+        ~MultiPipeline( );
+
+        /* 
+         * Decode frames from source with layout, tagged with source_id.
+         * Feeds may only be added while stopped.
+         */
+        void add_feed(CaptureSource *source, const Layout *layout,
+            uint16_t source_id);
+        unsigned int n_feeds(void) const { return feeds.size( ); }
+
+        void start(void);
+        /* stop and join the capture threads, and give back all frames */
+        void stop(void);
+
+        /* true once every source has run out of frames */
+        bool finished(void);
+
+        /* resend unchanged data after this many frames (0 = never) */
+        void set_keepalive(unsigned int frames) { keepalive.store(frames); }
+        /* 
+         * check for predicted clock steps hz times a second (0 = never);
+         * takes effect at start( )
+         */
+        void set_publish_rate(unsigned int hz) { publish_rate = hz; }
+        /* decode interlaced frames field by field (may only be set while stopped) */
+        void set_field_order(enum field_order order) { field_order = order; }
+        /* filter every feed's digits, as Pipeline::set_debounce (ditto) */
+        void set_debounce(unsigned int frames) { debounce_frames = frames; }
+        /* segment thresholds as Pipeline::set_adaptive (ditto) */
+        void set_adaptive(bool on) { adaptive = on; }
+
+        /* counters for one feed, or for all of them together */
+        void get_stats(unsigned int feed, struct pipeline_stats *stats);
+        void get_stats(struct pipeline_stats *stats);
+        void print_stats(FILE *out);
+        void print_timing(FILE *out);
+
+    protected:
+        struct captured_frame {
+            Picture *frame;
+            uint64_t captured;
+        };
+
+        struct decoded_frame {
+            /* when decoding finished */
+            uint64_t decoded;
+            /* capture time of the frame decoded before this one */
+            uint64_t previous;
+            /* false for keepalive resends */
+            bool changed;
+            struct scoreboard_state state;
+        };
+
+        struct feed {
+            feed(LatencyHistogram *debounce_time);
+
+            CaptureSource *source;
+            Layout layout;
+            uint16_t source_id;
+
+            SpscRing<struct captured_frame> ring;
+            /* filled by the decode task, drained by the output thread */
+            SpscRing<struct decoded_frame> output_ring;
+            /* a decode task for this feed is queued or running */
+            std::atomic<bool> scheduled;
+            std::atomic<bool> done;
+            std::thread capture_thread;
+
+            /* only touched by the decode task */
+            /* one for frames, and one for each field */
+            SamplePlan plans[3];
+            struct scoreboard_state state;
+            AdaptiveThreshold thresholds;
+            DigitFilter filter;
+            /* the last frame's timestamp, for split_frame */
+            uint64_t last_timestamp;
+            unsigned int since_send;
+            /* a change that didn't fit in output_ring */
+            bool unsent;
+            bool warned_geometry;
+
+            /* only touched by the output thread */
+            uint32_t sequence;
+            ClockPredictor predictor;
+            /* the predicted state */
+            struct scoreboard_state predicted;
+
+            std::atomic<uint64_t> n_captured, n_decoded, n_unchanged, n_sent;
+            std::atomic<uint64_t> n_predicted;
+        };
+
+        void capture_main(struct feed *f);
+        /* the decode task */
+        void decode_feed(struct feed *f);
+        void decode_frame(struct feed *f, struct captured_frame *in);
+        void decode_picture(struct feed *f, Picture *p);
+        void schedule(struct feed *f);
+        void output_main(void);
+        /* send the predicted state of every feed whose clock stepped */
+        void publish(uint64_t now);
+        /* send one decoded state of f's, if there is one */
+        bool output(struct feed *f);
+
+        Destination *dest;
+        WorkPool pool;
+        std::vector<struct feed *> feeds;
+
+        unsigned int publish_rate;
+        enum field_order field_order;
+        unsigned int debounce_frames;
+        bool adaptive;
+        std::thread output_thread;
+
+        std::atomic<bool> quit;
+        std::atomic<unsigned int> keepalive;
+        /* decode tasks queued or running */
+        std::atomic<unsigned int> active;
+        bool started;
+
+        /* as in Pipeline */
+        LatencyHistogram capture_time, queue_time, sample_time, decode_time;
+        LatencyHistogram debounce_time;
+        LatencyHistogram output_queue_time, send_time, total_time;
+};
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * options.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "options.h"
+#include "destination.h"
+#include "log.h"
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *argv0) {
+    fprintf(stderr, 
+        "usage: %s [-i source]... [-I top|bottom] [-l layout | -f file...]\n"
+        "          [-k frames] [-d frames] [-a] [-p legacy|v2 | -F] [-s id]\n"
+        "          [-o sink]... [-r hz] [-T secs] [-j threads] [-v|-q]...\n"
+        "  -i source   png:FILE, raw:FILE:WxH[:uyvy|:yuyv],\n"
+        "              v4l2:DEVICE[:WxH] or synth:WxH[:noise=N,...]\n"
+        "              (default png:hockey_clock.png); the headless program\n"
+        "              takes any number of these, the interactive one only\n"
+        "              uses the first\n"
+        "  -I order    the video is interlaced: decode each field on its own,\n"
+        "              top or bottom field first\n"
+        "  -l layout   scoreboard fields as name:rule:digits,... where rule\n"
+        "              is clock or int (default clock:clock:4)\n"
+        "  -f file     layout file to load (and save to, during setup); with\n"
+        "              several sources, give one for each, in the same\n"
+        "              order, or one for all of them\n"
+        "  -k frames   resend unchanged data after this many frames\n"
+        "              (default %d, 0 = only send changes)\n"
+        "  -d frames   believe a digit has changed only once it reads the\n"
+        "              same in this many frames in a row, or a clock steps\n"
+        "              to it (default 1: believe every read)\n"
+        "  -a          give each segment its own on/off threshold, which\n"
+        "              follows changes in the lighting (starting from the\n"
+        "              layout's)\n"
+        "  -p format   packet format: legacy (default, int32s only) or v2\n"
+        "  -F          send v2 packets (same as -p v2)\n"
+        "  -s id       source id to put in v2 packets (default 0); further\n"
+        "              sources get id+1, id+2...\n"
+        "  -o sink     send results to mcast:GROUP:PORT, udp:HOST:PORT,\n"
+        "              unix:PATH, file:PATH or shm:NAME; may be repeated\n"
+        "              (default %s)\n"
+        "  -r hz       also send running clocks as they are predicted to\n"
+        "              change, checking hz times a second (default: only\n"
+        "              send what is decoded)\n"
+        "  -T secs     print per-stage latency every secs seconds (default:\n"
+        "              only on SIGUSR1)\n"
+        "  -j threads  decode threads for several sources (default: one\n"
+        "              per CPU)\n"
+        "  -v, -q      more or less logging; -v prints every change of the\n"
+        "              decoded state, -vv per-frame decode warnings too\n",
+        argv0, DEFAULT_KEEPALIVE, DEFAULT_SINK);
+}
+
+bool parse_options(int argc, char **argv, struct options *opts) {
+    int opt;
+
+    opts->sources.clear( );
+    opts->layout_spec = "clock:clock:4";
+    opts->layout_files.clear( );
+    opts->keepalive = DEFAULT_KEEPALIVE;
+    opts->format = PACKET_LEGACY;
+    opts->source_id = 0;
+    opts->sinks.clear( );
+    opts->stats_interval = 0;
+    opts->field_order = PROGRESSIVE;
+    opts->debounce = 1;
+    opts->adaptive = false;
+    opts->publish_rate = 0;
+    opts->threads = 0;
+
+    while ((opt = getopt(argc, argv, "i:I:l:f:k:d:ap:Fs:o:r:T:j:vqh")) != -1) {
+        switch (opt) {
+            case 'i':
+                opts->sources.push_back(optarg);
+                break;
+            case 'I':
+                if (strcmp(optarg, "top") == 0) {
+                    opts->field_order = TOP_FIELD_FIRST;
+                } else if (strcmp(optarg, "bottom") == 0) {
+                    opts->field_order = BOTTOM_FIELD_FIRST;
+                } else {
+                    usage(argv[0]);
+                    return false;
+                }
+                break;
+            case 'l':
+                opts->layout_spec = optarg;
+                break;
+            case 'f':
+                opts->layout_files.push_back(optarg);
+                break;
+            case 'k':
+                opts->keepalive = atoi(optarg);
+                break;
+            case 'd':
+                opts->debounce = atoi(optarg);
+                break;
+            case 'a':
+                opts->adaptive = true;
+                break;
+            case 'p':
+                if (strcmp(optarg, "legacy") == 0) {
+                    opts->format = PACKET_LEGACY;
+                } else if (strcmp(optarg, "v2") == 0) {
+                    opts->format = PACKET_V2;
+                } else {
+                    usage(argv[0]);
+                    return false;
+                }
+                break;
+            case 'F':
+                opts->format = PACKET_V2;
+                break;
+            case 's':
+                opts->source_id = atoi(optarg);
+                break;
+            case 'o':
+                opts->sinks.push_back(optarg);
+                break;
+            case 'r':
+                opts->publish_rate = atoi(optarg);
+                break;
+            case 'T':
+                opts->stats_interval = atoi(optarg);
+                break;
+            case 'j':
+                opts->threads = atoi(optarg);
+                break;
+            case 'v':
+                if (log_level < LOG_DEBUG) {
+                    log_level++;
+                }
+                break;
+            case 'q':
+                if (log_level > LOG_ERROR) {
+                    log_level--;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return false;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return false;
+    }
+
+    if (opts->sources.empty( )) {
+        opts->sources.push_back("png:hockey_clock.png");
+    }
+
+    if (opts->layout_files.size( ) > 1 
+            && opts->layout_files.size( ) != opts->sources.size( )) {
+        usage(argv[0]);
+        return false;
+    }
+
+    if (opts->sinks.empty( )) {
+        opts->sinks.push_back(DEFAULT_SINK);
+    }
+
+    return true;
+}
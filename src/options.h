@@ -0,0 +1,57 @@
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+/*
+ * options.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "packet.h"
+#include "picture.h"
+
+#include <stdint.h>
+#include <vector>
+
+/* command line settings shared by the interactive and headless programs */
+struct options {
+    /* capture sources; the default one if none were given */
+    std::vector<const char *> sources;
+    const char *layout_spec;
+    /* 
+     * layout files, one per source, or one for all of them; empty if
+     * none were given
+     */
+    std::vector<const char *> layout_files;
+    unsigned int keepalive;
+    enum packet_format format;
+    /* of the first source; the rest get the ids after it */
+    uint16_t source_id;
+    /* where to send the results; DEFAULT_SINK if none were given */
+    std::vector<const char *> sinks;
+    /* seconds between latency dumps (0 = only on SIGUSR1) */
+    unsigned int stats_interval;
+    /* whole frames, or each field of interlaced ones */
+    enum field_order field_order;
+    /* segment thresholds follow the lighting */
+    bool adaptive;
+    /* frames a changed digit must agree for (1 = believe every read) */
+    unsigned int debounce;
+    /* how often to check for predicted clock steps (Hz, 0 = never) */
+    unsigned int publish_rate;
+    /* decode threads, with several sources (0 = one per CPU) */
+    unsigned int threads;
+};
+
+/* 
+ * Fill in opts from the command line, with defaults for anything not
+ * given. -v and -q set log_level directly. On a bad command line
+ * (including more than one layout file, but not one for every source),
+ * prints usage and returns false.
+ */
+bool parse_options(int argc, char **argv, struct options *opts);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * options_check.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+/*
+ * Checks that command lines parse to the options they should. Run by
+ * "make check"; prints what went wrong and exits nonzero on a failure.
+ */
+
+#include "options.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check_format(const char *what, int argc, const char **args,
+        enum packet_format want) {
+    struct options opts;
+    char *argv[8];
+    int i;
+
+    for (i = 0; i < argc; ++i) {
+        argv[i] = (char *)args[i];
+    }
+    argv[argc] = NULL;
+
+    /* 0 makes glibc's getopt start over from scratch */
+    optind = 0;
+    if (!parse_options(argc, argv, &opts)) {
+        fprintf(stderr, "%s: did not parse\n", what);
+        failures++;
+    } else if (opts.format != want) {
+        fprintf(stderr, "%s: format %d, should be %d\n", what,
+            opts.format, want);
+        failures++;
+    }
+}
+
+int main(void) {
+    const char *none[] = { "check" };
+    const char *legacy[] = { "check", "-p", "legacy" };
+    const char *v2[] = { "check", "-p", "v2" };
+    const char *flag[] = { "check", "-F" };
+
+    check_format("no format", 1, none, PACKET_LEGACY);
+    check_format("-p legacy", 3, legacy, PACKET_LEGACY);
+    check_format("-p v2", 3, v2, PACKET_V2);
+    check_format("-F", 2, flag, PACKET_V2);
+
+    if (failures != 0) {
+        fprintf(stderr, "%d option check(s) failed\n", failures);
+        return 1;
+    }
+    printf("options ok\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * packet.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "packet.h"
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v;
+    return p + 2;
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, v >> 32);
+    return put_u32(p + 4, v);
+}
+
+static void encode_legacy(const struct scoreboard_state *state, 
+        std::vector<uint8_t> *out) {
+    uint8_t *p;
+    unsigned int i;
+
+    out->resize(4 * state->values.size( ));
+    p = out->data( );
+    for (i = 0; i < state->values.size( ); ++i) {
+        p = put_u32(p, state->values[i]);
+    }
+}
+
+static void encode_v2(const struct scoreboard_state *state, 
+        std::vector<uint8_t> *out) {
+    uint8_t *p;
+    unsigned int i;
+    unsigned int n_fields = state->values.size( );
+    unsigned int n_digits = state->digits.size( );
+
+    out->resize(PACKET_HEADER_SIZE + 4 * n_fields + n_digits);
+    p = out->data( );
+
+    p = put_u32(p, PACKET_MAGIC);
+    *p++ = PACKET_VERSION;
+    *p++ = state->flags;
+    p = put_u16(p, state->source_id);
+    p = put_u32(p, state->sequence);
+    p = put_u64(p, state->capture_time);
+    p = put_u64(p, state->decode_time);
+    p = put_u16(p, n_fields);
+    p = put_u16(p, n_digits);
+
+    for (i = 0; i < n_fields; ++i) {
+        p = put_u32(p, state->values[i]);
+    }
+
+    for (i = 0; i < n_digits; ++i) {
+        *p++ = state->digits[i].confidence;
+    }
+}
+
+void encode_packet(enum packet_format format, 
+        const struct scoreboard_state *state, std::vector<uint8_t> *out) {
+    switch (format) {
+        case PACKET_LEGACY:
+            encode_legacy(state, out);
+            break;
+
+        case PACKET_V2:
+            encode_v2(state, out);
+            break;
+    }
+}
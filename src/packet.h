@@ -0,0 +1,54 @@
+#ifndef _PACKET_H
+#define _PACKET_H
+
+/*
+ * packet.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "decoder.h"
+
+#include <stdint.h>
+#include <vector>
+
+enum packet_format {
+    /* one int32 per field and nothing else (the original protocol) */
+    PACKET_LEGACY,
+    PACKET_V2
+};
+
+/*
+ * Version 2 packet. All integers are big-endian.
+ *
+ *   offset  size
+ *        0     4  magic, "7SEG"
+ *        4     1  version (2)
+ *        5     1  flags, STATE_* (see decoder.h)
+ *        6     2  source id
+ *        8     4  sequence number, one more for each packet from a source
+ *       12     8  frame capture time, ns
+ *       20     8  decode time, ns
+ *       28     2  number of fields, F
+ *       30     2  number of digits, D
+ *       32   4*F  field values: int32, clocks in tenths, -1 if unreadable
+ *   32+4*F     D  confidence of each digit, 0-255
+ *
+ * Both times are on the sender's CLOCK_MONOTONIC, so their difference is
+ * the decoding latency, and a receiver that tracks the offset between
+ * that clock and its own can tell how old the data is. In a packet
+ * flagged STATE_PREDICTED, the decode time is when the values were
+ * predicted for, and the capture time that of the last frame read.
+ */
+#define PACKET_MAGIC 0x37534547
+#define PACKET_VERSION 2
+#define PACKET_HEADER_SIZE 32
+
+/* serialize a state in the given format into out (resized to fit) */
+void encode_packet(enum packet_format format, 
+    const struct scoreboard_state *state, std::vector<uint8_t> *out);
+
+#endif
@@ -8,6 +8,7 @@
  */
 
 #include "picture.h"
+#include "picture_kernels.h"
 
 #include <stdlib.h>
 #include <stdexcept>
@@ -16,58 +17,306 @@
 #include <malloc.h> // memalign
 #include <stdarg.h>
 
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #define align_malloc malloc
 #define align_realloc realloc
 
 /* 16 works out nicely on scanline boundaries but we can go higher*/
 #define ALIGN_ON 64
 
+/* cached pictures kept per size bucket, and per thread */
 #define FREELIST_MAX 16
+#define THREAD_CACHE_MAX 8
+
+/*
+ * Pool of Pictures that keep their data buffers. Buffers are bucketed by
+ * (size class, alignment) so a frame of the same geometry comes back with
+ * a buffer that is already big enough, and no malloc/free happens in steady
+ * state. Each thread keeps a few pictures of its own so the common case of
+ * alloc/free on the same thread never takes the lock.
+ */
+class PicturePool {
+    public:
+        static Picture *get(size_t size, size_t align);
+        static void put(Picture *pic);
+        static void stats(struct picture_pool_stats *out);
+
+    protected:
+        typedef std::pair<size_t, size_t> key;
+
+        struct thread_cache {
+            Picture *pics[THREAD_CACHE_MAX];
+            unsigned int n;
+
+            thread_cache( ) : n(0) { }
+            ~thread_cache( );
+        };
+
+        static size_t size_class(size_t size);
+        static void put_shared(Picture *pic);
+
+        static std::mutex lock;
+        static std::map<key, std::vector<Picture *> > buckets;
+        static thread_local thread_cache cache;
+
+        static std::atomic<uint64_t> hits, misses, releases, discards;
+};
+
+std::mutex PicturePool::lock;
+std::map<PicturePool::key, std::vector<Picture *> > PicturePool::buckets;
+thread_local PicturePool::thread_cache PicturePool::cache;
+std::atomic<uint64_t> PicturePool::hits(0);
+std::atomic<uint64_t> PicturePool::misses(0);
+std::atomic<uint64_t> PicturePool::releases(0);
+std::atomic<uint64_t> PicturePool::discards(0);
+
+/* 
+ * Round up to a quarter of the size's power of two, so buffers of nearly
+ * the same size share a bucket and at most 25% is wasted.
+ */
+size_t PicturePool::size_class(size_t size) {
+    size_t step;
+
+    if (size <= 1024) {
+        return (size + 255) & ~(size_t)255;
+    }
+
+    step = ((size_t)1 << (8 * sizeof(size_t) - 1 - __builtin_clzl(size))) / 4;
+    return (size + step - 1) & ~(step - 1);
+}
+
+Picture *PicturePool::get(size_t size, size_t align) {
+    key k(size_class(size), align);
+    Picture *pic = NULL;
+    unsigned int i;
+
+    /* first try this thread's own cache */
+    for (i = 0; i < cache.n; ++i) {
+        if (cache.pics[i]->alloc_size == k.first 
+                && cache.pics[i]->alloc_align == k.second) {
+            pic = cache.pics[i];
+            cache.pics[i] = cache.pics[--cache.n];
+            break;
+        }
+    }
+
+    if (pic == NULL) {
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<key, std::vector<Picture *> >::iterator it = buckets.find(k);
+        if (it != buckets.end( ) && !it->second.empty( )) {
+            pic = it->second.back( );
+            it->second.pop_back( );
+        }
+    }
+
+    if (pic != NULL) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return pic;
+    }
+
+    misses.fetch_add(1, std::memory_order_relaxed);
+    pic = new Picture;
+    if (k.first == 0) {
+        /* views never get a buffer of their own */
+        return pic;
+    }
+
+    pic->data = (uint8_t *)memalign(align, k.first);
+    if (pic->data == NULL) {
+        delete pic;
+        throw std::runtime_error("memalign failed");
+    }
+    pic->alloc_size = k.first;
+    pic->alloc_align = align;
+    return pic;
+}
+
+void PicturePool::put(Picture *pic) {
+    releases.fetch_add(1, std::memory_order_relaxed);
+
+    if (cache.n < THREAD_CACHE_MAX) {
+        cache.pics[cache.n++] = pic;
+    } else {
+        put_shared(pic);
+    }
+}
+
+void PicturePool::put_shared(Picture *pic) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<Picture *> &bucket = buckets[key(pic->alloc_size, pic->alloc_align)];
+
+    if (bucket.size( ) >= FREELIST_MAX) {
+        discards.fetch_add(1, std::memory_order_relaxed);
+        delete pic;
+    } else {
+        /* reserve up front so releasing never allocates later */
+        bucket.reserve(FREELIST_MAX);
+        bucket.push_back(pic);
+    }
+}
+
+PicturePool::thread_cache::~thread_cache( ) {
+    /* a thread is going away, hand its pictures to everyone else */
+    while (n > 0) {
+        put_shared(pics[--n]);
+    }
+}
+
+void PicturePool::stats(struct picture_pool_stats *out) {
+    out->hits = hits.load(std::memory_order_relaxed);
+    out->misses = misses.load(std::memory_order_relaxed);
+    out->releases = releases.load(std::memory_order_relaxed);
+    out->discards = discards.load(std::memory_order_relaxed);
+}
 
 Picture::Picture( ) {
     data = NULL;
+    alloc_size = 0;
+    alloc_align = 0;
 #ifdef HAVE_PANGOCAIRO
     font_description = NULL;
 #endif
 }
 
-void Picture::alloc_data(size_t size) {
-    if (data) {
-        ::free(data);
-    }
-    data = (uint8_t *)memalign(ALIGN_ON, size);
-    alloc_size = size;
-}
-
 Picture *Picture::alloc(uint16_t w, uint16_t h, uint16_t line_pitch,
-        enum pixel_format pix_fmt) {
+        enum pixel_format pix_fmt, size_t align) {
     Picture *candidate;
-    size_t pic_size = h * line_pitch;
+    size_t pic_size = (size_t)h * line_pitch;
 
-    // See if we can get something off the free list.
-    if (!free_list.empty( )) {
-        candidate = free_list.front( );
-        free_list.pop_front( );
-    } else {
-        candidate = new Picture;
+    if (align == 0) {
+        align = ALIGN_ON;
     }
 
+    candidate = PicturePool::get(pic_size, align);
     candidate->w = w;
     candidate->h = h;
     candidate->line_pitch = line_pitch;
     candidate->pix_fmt = pix_fmt;
-    candidate->alloc_data(pic_size);
+    candidate->x_offset = 0;
+    candidate->y_offset = 0;
+    candidate->field = PICTURE_FRAME;
+    candidate->timestamp = 0;
     return candidate;
 }
 
+Picture *Picture::view(Picture *src, uint16_t x, uint16_t y,
+        uint16_t w, uint16_t h) {
+    Picture *view = PicturePool::get(0, 0);
+
+    /* clip to the source */
+    if (x > src->w) {
+        x = src->w;
+    }
+    if (y > src->h) {
+        y = src->h;
+    }
+    if (w > src->w - x) {
+        w = src->w - x;
+    }
+    if (h > src->h - y) {
+        h = src->h - y;
+    }
+
+    /* UYVY8 and YUYV8 can only be cut between pixel pairs */
+    if (src->pix_fmt == UYVY8 || src->pix_fmt == YUYV8) {
+        if (x % 2 != 0) {
+            x--;
+            w++;
+        }
+        if (w % 2 != 0) {
+            if (x + w < src->w) {
+                w++;
+            } else {
+                w--;
+            }
+        }
+    }
+
+    view->data = src->scanline(y) + src->pixel_pitch( ) * x;
+    view->w = w;
+    view->h = h;
+    view->line_pitch = src->line_pitch;
+    view->pix_fmt = src->pix_fmt;
+    view->x_offset = src->x_offset + x;
+    view->y_offset = src->y_offset + y;
+    view->field = src->field;
+    view->timestamp = src->timestamp;
+    return view;
+}
+
+Picture *Picture::field_view(Picture *src, enum picture_field field) {
+    Picture *view;
+    unsigned int first = (field == PICTURE_BOTTOM_FIELD) ? 1 : 0;
+
+    if (src->field != PICTURE_FRAME || field == PICTURE_FRAME) {
+        throw std::runtime_error("Picture::field_view: need a frame, and a field of it");
+    }
+
+    if (2 * (unsigned int)src->line_pitch > 0xffff) {
+        throw std::runtime_error("Picture::field_view: lines too long");
+    }
+
+    view = PicturePool::get(0, 0);
+    view->data = src->scanline(first);
+    view->w = src->w;
+    view->h = (src->h + 1 - first) / 2;
+    view->line_pitch = 2 * src->line_pitch;
+    view->pix_fmt = src->pix_fmt;
+    view->x_offset = src->x_offset;
+    view->y_offset = src->y_offset / 2;
+    view->field = field;
+    view->timestamp = src->timestamp;
+    return view;
+}
+
+Picture *Picture::wrap(uint8_t *data, uint16_t w, uint16_t h,
+        uint16_t line_pitch, enum pixel_format pix_fmt) {
+    Picture *pic = PicturePool::get(0, 0);
+
+    pic->data = data;
+    pic->w = w;
+    pic->h = h;
+    pic->line_pitch = line_pitch;
+    pic->pix_fmt = pix_fmt;
+    pic->x_offset = 0;
+    pic->y_offset = 0;
+    pic->field = PICTURE_FRAME;
+    pic->timestamp = 0;
+    return pic;
+}
+
 Picture *Picture::copy(Picture *src) {
-    Picture *dest = Picture::alloc(src->w, src->h, src->line_pitch, src->pix_fmt);
-    memcpy(dest->data, src->data, src->h * src->line_pitch);
+    Picture *dest;
+    size_t row_size;
+    int i;
+
+    if (src->alloc_size != 0) {
+        dest = Picture::alloc(src->w, src->h, src->line_pitch, src->pix_fmt);
+        memcpy(dest->data, src->data, (size_t)src->h * src->line_pitch);
+    } else {
+        /* a view's rows are spread over its parent, copy them one by one */
+        row_size = src->w * src->pixel_pitch( );
+        dest = Picture::alloc(src->w, src->h, row_size, src->pix_fmt);
+        for (i = 0; i < src->h; i++) {
+            memcpy(dest->scanline(i), src->scanline(i), row_size);
+        }
+    }
+
+    dest->x_offset = src->x_offset;
+    dest->y_offset = src->y_offset;
+    dest->field = src->field;
+    dest->timestamp = src->timestamp;
     return dest;
 }
 
 Picture::~Picture( ) {
-    if (data) {
+    /* views (alloc_size == 0) point into someone else's buffer */
+    if (data && alloc_size != 0) {
         ::free(data);
     }
 
@@ -79,13 +328,15 @@ Picture::~Picture( ) {
 }
 
 void Picture::free(Picture *pic) {
-    if (free_list.size( ) >= FREELIST_MAX) {
-        delete pic;
-    } else {
-        free_list.push_back(pic);
+    if (pic != NULL) {
+        PicturePool::put(pic);
     }
 }
 
+void Picture::pool_stats(struct picture_pool_stats *stats) {
+    PicturePool::stats(stats);
+}
+
 Picture *Picture::convert_to_format(enum pixel_format pix_fmt) {
     switch (pix_fmt) {
         case RGB8:
@@ -100,6 +351,9 @@ Picture *Picture::convert_to_format(enum pixel_format pix_fmt) {
         case YUVA8:
             return to_yuva8( );
 
+        case A8:
+            return to_y8( );
+
         default:
             throw std::runtime_error("Unknown pixel format requested");
     }
@@ -116,6 +370,13 @@ Picture *Picture::to_rgb8(void) {
         case BGRA8:
             return bgra8_to_rgb8( );
 
+        case YUYV8: {
+            Picture *uyvy = yuyv8_to_uyvy8( );
+            Picture *out = uyvy->uyvy8_to_rgb8( );
+            Picture::free(uyvy);
+            return out;
+        }
+
         default:
             throw std::runtime_error("Cannot convert this format to RGB8");
     }
@@ -132,6 +393,9 @@ Picture *Picture::to_uyvy8(void) {
         case YUV8:
             return yuv8_to_uyvy8( );
 
+        case YUYV8:
+            return yuyv8_to_uyvy8( );
+
         default:
             throw std::runtime_error("Cannot convert this format to UYVY8");
     }
@@ -164,211 +428,115 @@ Picture *Picture::to_yuva8(void) {
     return NULL; /* suppress a meaningless warning - the switch either returns or throws */
 }
 
-#undef CLAMP
-#undef SCLAMP
-#define CLAMP(x) ( (x < 256) ? x : 0 )
-#define SCLAMP(x) ( (x > 0) ? CLAMP(x) : 0 )
+/* luma only, as a single-channel A8 plane */
+Picture *Picture::to_y8(void) {
+    switch (this->pix_fmt) {
+        case A8:
+            return Picture::copy(this);
 
-Picture *Picture::rgb8_to_uyvy8(void) {
-    int i, j;
-    uint8_t r, g, b;
-    uint16_t y1, y2, u, v;
+        case RGB8:
+            return rgb8_to_y8( );
 
-    /* UYVY8 = 4 bytes/2 pixels (w must be even) */
-    assert(this->w % 2 == 0);
-    Picture *out = Picture::alloc(this->w, this->h, 2*this->w, UYVY8);
-    uint8_t *pix_ptr, *out_ptr;
-
-    for (i = 0; i < this->h; i++) {
-        pix_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
-        for (j = 0; j < this->w; j += 2) {            
-            r = *pix_ptr++;
-            g = *pix_ptr++;
-            b = *pix_ptr++;
-
-            y1 = 16 + (r * 66 + g * 129 + b * 25) / 256;
-            u = 128 + (b * 112 - g * 74 - r * 37) / 256;
-            v = 128 + (r * 112 - g * 94 - b * 18) / 256;
-
-            r = *pix_ptr++;
-            g = *pix_ptr++;
-            b = *pix_ptr++;
-
-            y2 = 16 + (r * 66 + g * 129 + b * 25) / 256;
-            u += 128 + (b * 112 - g * 74 - r * 37) / 256;
-            v += 128 + (r * 112 - g * 94 - b * 18) / 256;
-            
-            u >>= 1;
-            v >>= 1;
-
-            *out_ptr++ = u;
-            *out_ptr++ = y1;
-            *out_ptr++ = v;
-            *out_ptr++ = y2;
-        }
+        case BGRA8:
+            return bgra8_to_y8( );
+
+        case UYVY8:
+            return uyvy8_to_y8( );
+
+        case YUV8:
+            return yuv8_to_y8( );
+
+        case YUVA8:
+            return yuva8_to_y8( );
+
+        case YUYV8:
+            return yuyv8_to_y8( );
+
+        default:
+            throw std::runtime_error("Cannot convert this format to A8");
     }
-    
-    return out;
 }
 
-Picture *Picture::bgra8_to_rgb8(void) {
-    int i, j;
-    uint8_t r, g, b, a;
+/* run a scanline kernel over every row of in, writing to out */
+static Picture *convert_rows(Picture *in, Picture *out, convert_row_fn kernel) {
+    int i;
 
-    Picture *out = Picture::alloc(this->w, this->h, 3*this->w, RGB8);
-    uint8_t *pix_ptr, *out_ptr;
-
-    for (i = 0; i < this->h; i++) {
-        pix_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
-        for (j = 0; j < this->w; j++) {            
-            b = *pix_ptr++;
-            g = *pix_ptr++;
-            r = *pix_ptr++;
-            a = *pix_ptr++;
-
-            *out_ptr++ = r;
-            *out_ptr++ = g;
-            *out_ptr++ = b;
-        }
+    for (i = 0; i < in->h; i++) {
+        kernel(in->scanline(i), out->scanline(i), in->w);
     }
-    
+
+    out->x_offset = in->x_offset;
+    out->y_offset = in->y_offset;
+    out->field = in->field;
+    out->timestamp = in->timestamp;
     return out;
+}
+
+Picture *Picture::rgb8_to_uyvy8(void) {
+    /* UYVY8 = 4 bytes/2 pixels (w must be even) */
+    assert(this->w % 2 == 0);
+    Picture *out = Picture::alloc(this->w, this->h, 2*this->w, UYVY8);
+    return convert_rows(this, out, get_picture_kernels( )->rgb8_to_uyvy8);
+}
 
+Picture *Picture::bgra8_to_rgb8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, 3*this->w, RGB8);
+    return convert_rows(this, out, get_picture_kernels( )->bgra8_to_rgb8);
 }
 
 Picture *Picture::bgra8_to_yuva8(void) {
-    int i, j;
-    uint8_t r, g, b, a;
-    uint16_t y, u, v;
-
     Picture *out = Picture::alloc(this->w, this->h, 4*this->w, YUVA8);
-    uint8_t *pix_ptr, *out_ptr;
-
-    for (i = 0; i < this->h; i++) {
-        pix_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
-        for (j = 0; j < this->w; j++) {            
-            b = *pix_ptr++;
-            g = *pix_ptr++;
-            r = *pix_ptr++;
-            a = *pix_ptr++;
-
-            y = 16 + (r * 66 + g * 129 + b * 25) / 256;
-            u = 128 + (b * 112 - g * 74 - r * 37) / 256;
-            v = 128 + (r * 112 - g * 94 - b * 18) / 256;
-
-            *out_ptr++ = y;
-            *out_ptr++ = u;
-            *out_ptr++ = v;
-            *out_ptr++ = a;
-        }
-    }
-    
-    return out;
+    return convert_rows(this, out, get_picture_kernels( )->bgra8_to_yuva8);
 }
 
-/* THIS IS BROKEN and results in video artifacts */
-/* (maybe not anymore??) */
 Picture *Picture::uyvy8_to_rgb8(void) {
-    int i, j;
-    int16_t r, g, b;
-    uint8_t u, y1, v, y2;
     Picture *out = Picture::alloc(this->w, this->h, 3*this->w, RGB8);
-    uint8_t *in_ptr, *out_ptr;
-
-    for (i = 0; i < this->h; i++) {
-        in_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
-
-        for (j = 0; j < this->w; j += 2) {
-            u = *in_ptr++;
-            y1 = *in_ptr++;
-            v = *in_ptr++;
-            y2 = *in_ptr++;
-
-            r = (298 * y1 + 409 * v) / 256 - 223;
-            g = (298 * y1 - 100 * u - 208 * v) / 256 + 135;
-            b = (298 * y1 + 516 * u) / 256 - 277;
-
-            *out_ptr++ = SCLAMP(r);
-            *out_ptr++ = SCLAMP(g);
-            *out_ptr++ = SCLAMP(b);
-
-            r = (298 * y2 + 409 * v) / 256 - 223;
-            g = (298 * y2 - 100 * u - 208 * v) / 256 + 135;
-            b = (298 * y2 + 516 * u) / 256 - 277;
-
-            *out_ptr++ = SCLAMP(r);
-            *out_ptr++ = SCLAMP(g);
-            *out_ptr++ = SCLAMP(b);
-        }
-    }
-
-    return out;
+    return convert_rows(this, out, get_picture_kernels( )->uyvy8_to_rgb8);
 }
 
 Picture *Picture::uyvy8_to_yuv8(void) {
-    int i, j;
-    uint8_t u, y1, v, y2;
     Picture *out = Picture::alloc(this->w, this->h, 3*this->w, YUV8);
-    uint8_t *in_ptr, *out_ptr;
+    return convert_rows(this, out, get_picture_kernels( )->uyvy8_to_yuv8);
+}
 
-    for (i = 0; i < this->h; i++) {
-        in_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
+Picture *Picture::yuv8_to_uyvy8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, 2*this->w, UYVY8);
+    return convert_rows(this, out, get_picture_kernels( )->yuv8_to_uyvy8);
+}
 
-        for (j = 0; j < this->w; j+=2) {
-            u = *in_ptr++;
-            y1 = *in_ptr++;
-            v = *in_ptr++;
-            y2 = *in_ptr++;
+Picture *Picture::rgb8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->rgb8_to_y8);
+}
 
-            *out_ptr++ = y1;
-            *out_ptr++ = u;
-            *out_ptr++ = v;
+Picture *Picture::bgra8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->bgra8_to_y8);
+}
 
-            *out_ptr++ = y2;
-            *out_ptr++ = u;
-            *out_ptr++ = v;
-        }
-    }
+Picture *Picture::uyvy8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->uyvy8_to_y8);
+}
 
-    return out;
+Picture *Picture::yuv8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->yuv8_to_y8);
 }
 
-Picture *Picture::yuv8_to_uyvy8(void) {
-    int i, j;
-    uint16_t u, v;
-    uint8_t y1, y2;
+Picture *Picture::yuva8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->yuva8_to_y8);
+}
 
+Picture *Picture::yuyv8_to_uyvy8(void) {
     Picture *out = Picture::alloc(this->w, this->h, 2*this->w, UYVY8);
-    uint8_t *in_ptr, *out_ptr;
-
-    for (i = 0; i < this->h; i++) {
-        in_ptr = this->scanline(i);
-        out_ptr = out->scanline(i);
-
-        for (j = 0; j < this->w; j += 2) {
-            y1 = *in_ptr++;
-            u = *in_ptr++;
-            v = *in_ptr++;
-            y2 = *in_ptr++;
-            u += *in_ptr++;
-            v += *in_ptr++;
-
-            u /= 2;
-            v /= 2;
-    
-            *out_ptr++ = u;
-            *out_ptr++ = y1;
-            *out_ptr++ = v;
-            *out_ptr++ = y2;
-        }
-    }
+    return convert_rows(this, out, get_picture_kernels( )->yuyv8_to_uyvy8);
+}
 
-    return out;
+Picture *Picture::yuyv8_to_y8(void) {
+    Picture *out = Picture::alloc(this->w, this->h, this->w, A8);
+    return convert_rows(this, out, get_picture_kernels( )->yuyv8_to_y8);
 }
 
 int Picture::pixel_pitch(void) {
@@ -377,12 +545,17 @@ int Picture::pixel_pitch(void) {
             return 1;
 
         case UYVY8:
+        case YUYV8:
             return 2;
 
         case RGB8:
         case YUV8:
             return 3;
 
+        case BGRA8:
+        case YUVA8:
+            return 4;
+
         default:
             throw std::runtime_error("cannot deal with that pixel format");
             break;
@@ -428,6 +601,9 @@ void Picture::draw(Picture *src, uint_fast16_t x, uint_fast16_t y,
     blit_h = src->h;
 
     if (x >= w || y >= h) {
+        if (src_conv != src) {
+            Picture::free(src_conv);
+        }
         return;
     }
 
@@ -439,15 +615,15 @@ void Picture::draw(Picture *src, uint_fast16_t x, uint_fast16_t y,
         blit_h = h - y;
     }
 
-    if (src->pix_fmt != BGRA8 && src->pix_fmt != YUVA8) {
+    if (src_conv->pix_fmt != BGRA8 && src_conv->pix_fmt != YUVA8) {
         for (blit_y = 0; blit_y < blit_h; ++blit_y) {
-            dst_start_ptr = data + line_pitch * blit_y + pixel_pitch( ) * x;
-            memcpy(dst_start_ptr, src->scanline(blit_y), pixel_pitch( ) * blit_w);
+            dst_start_ptr = scanline(y + blit_y) + pixel_pitch( ) * x;
+            memcpy(dst_start_ptr, src_conv->scanline(blit_y), pixel_pitch( ) * blit_w);
         }
-    } else if (src->pix_fmt == BGRA8 && pix_fmt == RGB8) {
+    } else if (src_conv->pix_fmt == BGRA8 && pix_fmt == RGB8) {
         for (blit_y = 0; blit_y < blit_h; ++blit_y) {
             dst_start_ptr = scanline(y + blit_y) + pixel_pitch( ) * x;
-            src_start_ptr = src->scanline(blit_y);
+            src_start_ptr = src_conv->scanline(blit_y);
             for (blit_x = 0; blit_x < blit_w; ++blit_x) {
                 ad = dst_start_ptr[0];
                 bd = dst_start_ptr[1];
@@ -467,10 +643,10 @@ void Picture::draw(Picture *src, uint_fast16_t x, uint_fast16_t y,
                 *dst_start_ptr++ = cd / 256;
             }
         }
-    } else if (src->pix_fmt == YUVA8 && pix_fmt == YUV8) {
+    } else if (src_conv->pix_fmt == YUVA8 && pix_fmt == YUV8) {
         for (blit_y = 0; blit_y < blit_h; ++blit_y) {
             dst_start_ptr = scanline(y + blit_y) + pixel_pitch( ) * x;
-            src_start_ptr = src->scanline(blit_y);
+            src_start_ptr = src_conv->scanline(blit_y);
             for (blit_x = 0; blit_x < blit_w; ++blit_x) {
                 ad = dst_start_ptr[0];
                 bd = dst_start_ptr[1];
@@ -492,9 +668,15 @@ void Picture::draw(Picture *src, uint_fast16_t x, uint_fast16_t y,
         }
 
     } else {
+        if (src_conv != src) {
+            Picture::free(src_conv);
+        }
         throw std::runtime_error("can't handle that yet");
     }
 
+    if (src_conv != src) {
+        Picture::free(src_conv);
+    }
 }
 
 
@@ -532,11 +714,14 @@ void Picture::drawA8(Picture *src, uint_fast16_t x, uint_fast16_t y,
         case UYVY8:
             throw std::runtime_error("this doesn't quite work yet");
             blend_src[0] = u;
-            blend_src[1] = y;
+            blend_src[1] = y1;
             blend_src[2] = v;
-            blend_src[3] = y;
+            blend_src[3] = y1;
             blend_pitch = 4;
             break;
+
+        default:
+            throw std::runtime_error("drawA8: unsupported destination format");
     }
 
     blit_w = src->w;
@@ -556,12 +741,12 @@ void Picture::drawA8(Picture *src, uint_fast16_t x, uint_fast16_t y,
 
     for (blit_y = 0; blit_y < blit_h; ++blit_y) {
         src_ptr = src->scanline(blit_y);
-        my_ptr = scanline(blit_y) + pixel_pitch( ) * x;
+        my_ptr = scanline(y + blit_y) + pixel_pitch( ) * x;
         for (blit_x = 0; blit_x < blit_w; ++blit_x) {
             alpha = src_ptr[blit_x];
             for (j = 0; j < blend_pitch; ++j) {
-                /* alpha blending each pixel */
-                blend = (alpha * *my_ptr + (256 - alpha) * blend_src[j]) / 256;
+                /* alpha blending each pixel: alpha is the source's coverage */
+                blend = (alpha * blend_src[j] + (256 - alpha) * *my_ptr) / 256;
                 *my_ptr = blend;
                 ++my_ptr;
             }
@@ -656,4 +841,3 @@ Picture *Picture::from_png(const char *filename) {
     return ret;
 }
 #endif
-std::list<Picture *> Picture::free_list;
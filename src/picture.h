@@ -10,11 +10,37 @@
  * accompanying COPYING file. Otherwise, all rights reserved.
  */
 
-#include <list>
+#include <stddef.h>
 #include <stdint.h>
 
 enum pixel_format {
-    RGB8, UYVY8, YUV8, BGRA8, YUVA8, A8
+    RGB8, UYVY8, YUV8, BGRA8, YUVA8, A8, YUYV8
+};
+
+/* what part of an interlaced frame a picture holds */
+enum picture_field {
+    /* all of it (or the frame isn't interlaced) */
+    PICTURE_FRAME,
+    /* the even lines (0, 2, 4...), or the odd ones */
+    PICTURE_TOP_FIELD,
+    PICTURE_BOTTOM_FIELD
+};
+
+/* how to take frames apart before decoding them */
+enum field_order {
+    /* decode whole frames */
+    PROGRESSIVE,
+    /* decode each field on its own, in the order they were captured */
+    TOP_FIELD_FIRST,
+    BOTTOM_FIELD_FIRST
+};
+
+/* counters for the Picture buffer pool */
+struct picture_pool_stats {
+    uint64_t hits;      /* allocations served with a cached buffer */
+    uint64_t misses;    /* allocations that had to go to the heap */
+    uint64_t releases;  /* pictures handed back with Picture::free */
+    uint64_t discards;  /* released pictures deleted because the pool was full */
 };
 
 #ifdef HAVE_PANGOCAIRO
@@ -22,11 +48,33 @@ enum pixel_format {
 #include <pango/pangocairo.h>
 #endif
 
+class PicturePool;
+
 class Picture {
+    friend class PicturePool;
+
     public:
         uint8_t *data;
         uint16_t w, h, line_pitch;
 
+        /* 
+         * Where pixel (0, 0) sits in the frame this picture was cropped
+         * from. Zero unless it is (or was converted from) a view.
+         */
+        uint16_t x_offset, y_offset;
+
+        /* 
+         * PICTURE_FRAME unless it is (or was converted from) a field, in
+         * which case y and y_offset count lines of the field.
+         */
+        enum picture_field field;
+
+        /* 
+         * When the frame was captured, in CLOCK_MONOTONIC nanoseconds
+         * (0 = unknown). Views and conversions inherit it.
+         */
+        uint64_t timestamp;
+
         virtual ~Picture( );
 
         enum pixel_format pix_fmt;
@@ -35,13 +83,42 @@ class Picture {
             return data + line_pitch * n;
         }
 
+        /* align = 0 uses the default buffer alignment */
         static Picture *alloc(uint16_t w, uint16_t h, uint16_t line_pitch,
-            enum pixel_format pix_fmt = RGB8);
+            enum pixel_format pix_fmt = RGB8, size_t align = 0);
         static Picture *copy(Picture *src);
+
+        /*
+         * A non-owning window onto src: no pixels are copied, and the
+         * view shares src's line_pitch. It must be freed (with free) before
+         * src is. UYVY8 and YUYV8 views are widened to whole pixel pairs.
+         */
+        static Picture *view(Picture *src, uint16_t x, uint16_t y,
+            uint16_t w, uint16_t h);
+
+        /*
+         * A non-owning view of one field of src (a whole frame), made by
+         * starting on line 0 or 1 and doubling the line_pitch; no pixels
+         * are copied. It must be freed before src is.
+         */
+        static Picture *field_view(Picture *src, enum picture_field field);
+
+        /*
+         * A non-owning picture over pixels that live somewhere else (a
+         * capture driver's buffer, a mapped file). Freeing it leaves the
+         * pixels alone.
+         */
+        static Picture *wrap(uint8_t *data, uint16_t w, uint16_t h,
+            uint16_t line_pitch, enum pixel_format pix_fmt);
         static void free(Picture *pic);
+        static void pool_stats(struct picture_pool_stats *stats);
 
         int pixel_pitch(void);
         
+        /* 
+         * Converting to A8 gives a luma plane: Y for the YUV formats,
+         * (r + 2g + b) / 4 for the RGB ones.
+         */
         Picture *convert_to_format(enum pixel_format pix_fmt);
 
         /* approximate some sort of fast blit (from A8 surface, color fill) */
@@ -60,6 +137,7 @@ class Picture {
         Picture *to_uyvy8(void);
         Picture *to_yuv8(void);
         Picture *to_yuva8(void);
+        Picture *to_y8(void);
 
         Picture *rgb8_to_uyvy8(void);
         Picture *uyvy8_to_rgb8(void);
@@ -67,18 +145,21 @@ class Picture {
         Picture *uyvy8_to_yuv8(void);
         Picture *bgra8_to_yuva8(void);
         Picture *bgra8_to_rgb8(void);
-
-        static std::list<Picture *> free_list;
-
-        void alloc_data(size_t size);
+        Picture *rgb8_to_y8(void);
+        Picture *bgra8_to_y8(void);
+        Picture *uyvy8_to_y8(void);
+        Picture *yuv8_to_y8(void);
+        Picture *yuva8_to_y8(void);
+        Picture *yuyv8_to_uyvy8(void);
+        Picture *yuyv8_to_y8(void);
 
         void drawA8(Picture *src, uint_fast16_t x, uint_fast16_t y,
             uint_fast8_t r, uint_fast8_t g, uint_fast8_t b);
 
-        uint16_t alloc_size;
+        /* capacity and alignment of data, for the buffer pool (0 = view) */
+        size_t alloc_size;
+        size_t alloc_align;
 
-        
-        
 #ifdef HAVE_PANGOCAIRO
         PangoFontDescription *font_description;
 #endif
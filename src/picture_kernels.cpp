@@ -0,0 +1,1157 @@
+/*
+ * picture_kernels.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ *
+ * Terms and conditions for copying this file are included in the
+ * accompanying COPYING file. Otherwise, all rights reserved.
+ */
+
+#include "picture_kernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+ * Scalar reference kernels. These are the original Picture loops, and
+ * define the exact output every other kernel set has to reproduce
+ * (including the rounding of integer division and the odd clamping).
+ */
+
+#undef CLAMP
+#undef SCLAMP
+#define CLAMP(x) ( (x < 256) ? x : 0 )
+#define SCLAMP(x) ( (x > 0) ? CLAMP(x) : 0 )
+
+static void rgb8_to_uyvy8_scalar(const uint8_t *pix_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    uint8_t r, g, b;
+    uint16_t y1, y2, u, v;
+
+    for (j = 0; j < w; j += 2) {
+        r = *pix_ptr++;
+        g = *pix_ptr++;
+        b = *pix_ptr++;
+
+        y1 = 16 + (r * 66 + g * 129 + b * 25) / 256;
+        u = 128 + (b * 112 - g * 74 - r * 37) / 256;
+        v = 128 + (r * 112 - g * 94 - b * 18) / 256;
+
+        r = *pix_ptr++;
+        g = *pix_ptr++;
+        b = *pix_ptr++;
+
+        y2 = 16 + (r * 66 + g * 129 + b * 25) / 256;
+        u += 128 + (b * 112 - g * 74 - r * 37) / 256;
+        v += 128 + (r * 112 - g * 94 - b * 18) / 256;
+
+        u >>= 1;
+        v >>= 1;
+
+        *out_ptr++ = u;
+        *out_ptr++ = y1;
+        *out_ptr++ = v;
+        *out_ptr++ = y2;
+    }
+}
+
+static void bgra8_to_rgb8_scalar(const uint8_t *pix_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    uint8_t r, g, b;
+
+    for (j = 0; j < w; j++) {
+        b = *pix_ptr++;
+        g = *pix_ptr++;
+        r = *pix_ptr++;
+        pix_ptr++; /* alpha */
+
+        *out_ptr++ = r;
+        *out_ptr++ = g;
+        *out_ptr++ = b;
+    }
+}
+
+static void bgra8_to_yuva8_scalar(const uint8_t *pix_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    uint8_t r, g, b, a;
+    uint16_t y, u, v;
+
+    for (j = 0; j < w; j++) {
+        b = *pix_ptr++;
+        g = *pix_ptr++;
+        r = *pix_ptr++;
+        a = *pix_ptr++;
+
+        y = 16 + (r * 66 + g * 129 + b * 25) / 256;
+        u = 128 + (b * 112 - g * 74 - r * 37) / 256;
+        v = 128 + (r * 112 - g * 94 - b * 18) / 256;
+
+        *out_ptr++ = y;
+        *out_ptr++ = u;
+        *out_ptr++ = v;
+        *out_ptr++ = a;
+    }
+}
+
+/* THIS IS BROKEN and results in video artifacts */
+/* (maybe not anymore??) */
+static void uyvy8_to_rgb8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    int16_t r, g, b;
+    uint8_t u, y1, v, y2;
+
+    for (j = 0; j < w; j += 2) {
+        u = *in_ptr++;
+        y1 = *in_ptr++;
+        v = *in_ptr++;
+        y2 = *in_ptr++;
+
+        r = (298 * y1 + 409 * v) / 256 - 223;
+        g = (298 * y1 - 100 * u - 208 * v) / 256 + 135;
+        b = (298 * y1 + 516 * u) / 256 - 277;
+
+        *out_ptr++ = SCLAMP(r);
+        *out_ptr++ = SCLAMP(g);
+        *out_ptr++ = SCLAMP(b);
+
+        r = (298 * y2 + 409 * v) / 256 - 223;
+        g = (298 * y2 - 100 * u - 208 * v) / 256 + 135;
+        b = (298 * y2 + 516 * u) / 256 - 277;
+
+        *out_ptr++ = SCLAMP(r);
+        *out_ptr++ = SCLAMP(g);
+        *out_ptr++ = SCLAMP(b);
+    }
+}
+
+static void uyvy8_to_yuv8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    uint8_t u, y1, v, y2;
+
+    for (j = 0; j < w; j+=2) {
+        u = *in_ptr++;
+        y1 = *in_ptr++;
+        v = *in_ptr++;
+        y2 = *in_ptr++;
+
+        *out_ptr++ = y1;
+        *out_ptr++ = u;
+        *out_ptr++ = v;
+
+        *out_ptr++ = y2;
+        *out_ptr++ = u;
+        *out_ptr++ = v;
+    }
+}
+
+static void yuv8_to_uyvy8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+    uint16_t u, v;
+    uint8_t y1, y2;
+
+    for (j = 0; j < w; j += 2) {
+        y1 = *in_ptr++;
+        u = *in_ptr++;
+        v = *in_ptr++;
+        y2 = *in_ptr++;
+        u += *in_ptr++;
+        v += *in_ptr++;
+
+        u /= 2;
+        v /= 2;
+
+        *out_ptr++ = u;
+        *out_ptr++ = y1;
+        *out_ptr++ = v;
+        *out_ptr++ = y2;
+    }
+}
+
+static void rgb8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = (in_ptr[0] + 2 * in_ptr[1] + in_ptr[2]) >> 2;
+        in_ptr += 3;
+    }
+}
+
+static void bgra8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = (in_ptr[0] + 2 * in_ptr[1] + in_ptr[2]) >> 2;
+        in_ptr += 4;
+    }
+}
+
+static void uyvy8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = in_ptr[1];
+        in_ptr += 2;
+    }
+}
+
+static void yuv8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = in_ptr[0];
+        in_ptr += 3;
+    }
+}
+
+static void yuva8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = in_ptr[0];
+        in_ptr += 4;
+    }
+}
+
+/* swapping the bytes of every 16-bit word goes both ways */
+static void yuyv8_to_uyvy8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        out_ptr[0] = in_ptr[1];
+        out_ptr[1] = in_ptr[0];
+        in_ptr += 2;
+        out_ptr += 2;
+    }
+}
+
+static void yuyv8_to_y8_scalar(const uint8_t *in_ptr, uint8_t *out_ptr,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j < w; j++) {
+        *out_ptr++ = in_ptr[0];
+        in_ptr += 2;
+    }
+}
+
+static const struct picture_kernels scalar_kernels = {
+    "scalar",
+    rgb8_to_uyvy8_scalar,
+    uyvy8_to_rgb8_scalar,
+    yuv8_to_uyvy8_scalar,
+    uyvy8_to_yuv8_scalar,
+    bgra8_to_yuva8_scalar,
+    bgra8_to_rgb8_scalar,
+    rgb8_to_y8_scalar,
+    bgra8_to_y8_scalar,
+    uyvy8_to_y8_scalar,
+    yuv8_to_y8_scalar,
+    yuva8_to_y8_scalar,
+    yuyv8_to_uyvy8_scalar,
+    yuyv8_to_y8_scalar
+};
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * SSE2 kernels. Pixels are worked on as one 32-bit lane apiece so that
+ * the 16x16->32 bit multiplies (_mm_madd_epi16) and the C rounding rules
+ * of the reference can be reproduced exactly. Any leftover pixels at the
+ * end of a row go through the scalar kernel.
+ */
+
+/* C-style (round toward zero) signed division of each int32 lane by 256 */
+static inline TARGET_SSE2 __m128i div256_sse2(__m128i n) {
+    __m128i bias = _mm_and_si128(_mm_srai_epi32(n, 31), _mm_set1_epi32(255));
+    return _mm_srai_epi32(_mm_add_epi32(n, bias), 8);
+}
+
+/* coefficient pair for _mm_madd_epi16 against lanes holding (lo | hi << 16) */
+static inline TARGET_SSE2 __m128i coef_sse2(int16_t lo, int16_t hi) {
+    return _mm_set1_epi32((int32_t)((uint16_t)lo | ((uint32_t)(uint16_t)hi << 16)));
+}
+
+/* the reference SCLAMP: anything outside 1..255 becomes 0 */
+static inline TARGET_SSE2 __m128i sclamp_sse2(__m128i x) {
+    __m128i in_range = _mm_and_si128(
+        _mm_cmpgt_epi32(x, _mm_setzero_si128( )),
+        _mm_cmplt_epi32(x, _mm_set1_epi32(256))
+    );
+    return _mm_and_si128(x, in_range);
+}
+
+/* 4 pixels as 0x00ccbbaa lanes -> 12 packed bytes */
+static inline TARGET_SSE2 void store_px24_sse2(uint8_t *out, __m128i px) {
+    const __m128i lo24 = _mm_set1_epi64x(0xffffffLL);
+    const __m128i hi24 = _mm_set1_epi64x(0xffffff000000LL);
+    const __m128i bytes0_5 = _mm_set_epi32(0, 0, 0xffff, -1);
+    const __m128i bytes6_11 = _mm_set_epi32(0, -1, (int32_t)0xffff0000, 0);
+    uint32_t tail;
+
+    /* squeeze each qword down to 6 bytes, then close the gap between them */
+    __m128i q = _mm_or_si128(_mm_and_si128(px, lo24),
+        _mm_and_si128(_mm_srli_epi64(px, 8), hi24));
+    __m128i v = _mm_or_si128(_mm_and_si128(q, bytes0_5),
+        _mm_and_si128(_mm_srli_si128(q, 2), bytes6_11));
+
+    _mm_storel_epi64((__m128i *)out, v);
+    tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+    memcpy(out + 8, &tail, sizeof(tail));
+}
+
+/* 12 packed bytes -> 4 pixels as 0x00ccbbaa lanes */
+static inline TARGET_SSE2 __m128i load_px24_sse2(const uint8_t *in) {
+    const __m128i lo24 = _mm_set1_epi64x(0xffffffLL);
+    const __m128i hi24 = _mm_set1_epi64x(0xffffff00000000LL);
+    const __m128i bytes0_5 = _mm_set_epi32(0, 0, 0xffff, -1);
+    const __m128i bytes8_13 = _mm_set_epi32(0xffff, -1, 0, 0);
+    uint32_t tail;
+
+    memcpy(&tail, in + 8, sizeof(tail));
+    __m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)in),
+        _mm_cvtsi32_si128(tail));
+    /* 6 bytes into each qword, then 3 bytes into each dword */
+    __m128i q = _mm_or_si128(_mm_and_si128(v, bytes0_5),
+        _mm_and_si128(_mm_slli_si128(v, 2), bytes8_13));
+    return _mm_or_si128(_mm_and_si128(q, lo24),
+        _mm_and_si128(_mm_slli_epi64(q, 8), hi24));
+}
+
+static TARGET_SSE2 void rgb8_to_uyvy8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+    unsigned int j;
+
+    for (j = 0; j + 4 <= w; j += 4) {
+        __m128i px = load_px24_sse2(in);
+        __m128i rb = _mm_and_si128(px, rb_mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), byte_mask);
+
+        __m128i y = _mm_add_epi32(_mm_set1_epi32(16), _mm_srli_epi32(
+            _mm_add_epi32(_mm_madd_epi16(rb, coef_sse2(66, 25)),
+                _mm_madd_epi16(g, coef_sse2(129, 0))), 8));
+        __m128i u = _mm_add_epi32(_mm_set1_epi32(128), div256_sse2(
+            _mm_add_epi32(_mm_madd_epi16(rb, coef_sse2(-37, 112)),
+                _mm_madd_epi16(g, coef_sse2(-74, 0)))));
+        __m128i v = _mm_add_epi32(_mm_set1_epi32(128), div256_sse2(
+            _mm_add_epi32(_mm_madd_epi16(rb, coef_sse2(112, -18)),
+                _mm_madd_epi16(g, coef_sse2(-94, 0)))));
+
+        /* average chroma of each pair into the even lanes */
+        u = _mm_srli_epi32(_mm_add_epi32(u, _mm_srli_epi64(u, 32)), 1);
+        v = _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi64(v, 32)), 1);
+
+        __m128i uyvy = _mm_or_si128(
+            _mm_or_si128(u, _mm_slli_epi32(y, 8)),
+            _mm_or_si128(_mm_slli_epi32(v, 16),
+                _mm_slli_epi32(_mm_srli_epi64(y, 32), 24))
+        );
+        uyvy = _mm_shuffle_epi32(uyvy, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storel_epi64((__m128i *)out, uyvy);
+
+        in += 12;
+        out += 8;
+    }
+
+    rgb8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void uyvy8_to_rgb8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    const __m128i uv_mask = _mm_set1_epi32(0x00ff00ff);
+    unsigned int j, k;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)in);
+        __m128i uv = _mm_and_si128(d, uv_mask);
+        __m128i luma[2], px[2];
+
+        __m128i rv = _mm_madd_epi16(uv, coef_sse2(0, 409));
+        __m128i guv = _mm_madd_epi16(uv, coef_sse2(-100, -208));
+        __m128i bu = _mm_madd_epi16(uv, coef_sse2(516, 0));
+
+        luma[0] = _mm_and_si128(_mm_srli_epi32(d, 8), byte_mask);
+        luma[1] = _mm_srli_epi32(d, 24);
+
+        for (k = 0; k < 2; ++k) {
+            __m128i yy = _mm_madd_epi16(luma[k], coef_sse2(298, 0));
+            __m128i r = sclamp_sse2(_mm_sub_epi32(
+                _mm_srai_epi32(_mm_add_epi32(yy, rv), 8), _mm_set1_epi32(223)));
+            __m128i g = sclamp_sse2(_mm_add_epi32(
+                div256_sse2(_mm_add_epi32(yy, guv)), _mm_set1_epi32(135)));
+            __m128i b = sclamp_sse2(_mm_sub_epi32(
+                _mm_srai_epi32(_mm_add_epi32(yy, bu), 8), _mm_set1_epi32(277)));
+
+            px[k] = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                _mm_slli_epi32(b, 16));
+        }
+
+        store_px24_sse2(out, _mm_unpacklo_epi32(px[0], px[1]));
+        store_px24_sse2(out + 12, _mm_unpackhi_epi32(px[0], px[1]));
+
+        in += 16;
+        out += 24;
+    }
+
+    uyvy8_to_rgb8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void yuv8_to_uyvy8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 4 <= w; j += 4) {
+        __m128i px = load_px24_sse2(in);
+        __m128i y = _mm_and_si128(px, byte_mask);
+        __m128i u = _mm_and_si128(_mm_srli_epi32(px, 8), byte_mask);
+        __m128i v = _mm_srli_epi32(px, 16);
+
+        u = _mm_srli_epi32(_mm_add_epi32(u, _mm_srli_epi64(u, 32)), 1);
+        v = _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi64(v, 32)), 1);
+
+        __m128i uyvy = _mm_or_si128(
+            _mm_or_si128(u, _mm_slli_epi32(y, 8)),
+            _mm_or_si128(_mm_slli_epi32(v, 16),
+                _mm_slli_epi32(_mm_srli_epi64(y, 32), 24))
+        );
+        uyvy = _mm_shuffle_epi32(uyvy, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storel_epi64((__m128i *)out, uyvy);
+
+        in += 12;
+        out += 8;
+    }
+
+    yuv8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void uyvy8_to_yuv8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    const __m128i u_mask = _mm_set1_epi32(0xff00);
+    const __m128i v_mask = _mm_set1_epi32(0xff0000);
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)in);
+        /* shared chroma: u moves up one byte, v stays put */
+        __m128i uv = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(d, 8), u_mask),
+            _mm_and_si128(d, v_mask));
+        __m128i px0 = _mm_or_si128(uv,
+            _mm_and_si128(_mm_srli_epi32(d, 8), byte_mask));
+        __m128i px1 = _mm_or_si128(uv, _mm_srli_epi32(d, 24));
+
+        store_px24_sse2(out, _mm_unpacklo_epi32(px0, px1));
+        store_px24_sse2(out + 12, _mm_unpackhi_epi32(px0, px1));
+
+        in += 16;
+        out += 24;
+    }
+
+    uyvy8_to_yuv8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void bgra8_to_yuva8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i pair_mask = _mm_set1_epi32(0x00ff00ff);
+    unsigned int j;
+
+    for (j = 0; j + 4 <= w; j += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)in);
+        __m128i br = _mm_and_si128(px, pair_mask);
+        __m128i ga = _mm_and_si128(_mm_srli_epi32(px, 8), pair_mask);
+
+        __m128i y = _mm_add_epi32(_mm_set1_epi32(16), _mm_srli_epi32(
+            _mm_add_epi32(_mm_madd_epi16(br, coef_sse2(25, 66)),
+                _mm_madd_epi16(ga, coef_sse2(129, 0))), 8));
+        __m128i u = _mm_add_epi32(_mm_set1_epi32(128), div256_sse2(
+            _mm_add_epi32(_mm_madd_epi16(br, coef_sse2(112, -37)),
+                _mm_madd_epi16(ga, coef_sse2(-74, 0)))));
+        __m128i v = _mm_add_epi32(_mm_set1_epi32(128), div256_sse2(
+            _mm_add_epi32(_mm_madd_epi16(br, coef_sse2(-18, 112)),
+                _mm_madd_epi16(ga, coef_sse2(-94, 0)))));
+        __m128i a = _mm_srli_epi32(px, 24);
+
+        __m128i yuva = _mm_or_si128(
+            _mm_or_si128(y, _mm_slli_epi32(u, 8)),
+            _mm_or_si128(_mm_slli_epi32(v, 16), _mm_slli_epi32(a, 24))
+        );
+        _mm_storeu_si128((__m128i *)out, yuva);
+
+        in += 16;
+        out += 16;
+    }
+
+    bgra8_to_yuva8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void bgra8_to_rgb8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    const __m128i g_mask = _mm_set1_epi32(0xff00);
+    unsigned int j;
+
+    for (j = 0; j + 4 <= w; j += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)in);
+        __m128i rgb = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), byte_mask),
+                _mm_and_si128(px, g_mask)),
+            _mm_slli_epi32(_mm_and_si128(px, byte_mask), 16)
+        );
+        store_px24_sse2(out, rgb);
+
+        in += 16;
+        out += 12;
+    }
+
+    bgra8_to_rgb8_scalar(in, out, w - j);
+}
+
+/* (byte0 + 2 * byte1 + byte2) / 4 of each 32-bit lane */
+static inline TARGET_SSE2 __m128i luma_sse2(__m128i px) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    __m128i sum = _mm_add_epi32(
+        _mm_add_epi32(_mm_and_si128(px, byte_mask),
+            _mm_and_si128(_mm_srli_epi32(px, 16), byte_mask)),
+        _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(px, 8), byte_mask), 1)
+    );
+    return _mm_srli_epi32(sum, 2);
+}
+
+/* 16 lanes holding 0..255 -> 16 bytes */
+static inline TARGET_SSE2 void store_y16_sse2(uint8_t *out, __m128i a, 
+        __m128i b, __m128i c, __m128i d) {
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(
+        _mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+}
+
+static TARGET_SSE2 void rgb8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        store_y16_sse2(out,
+            luma_sse2(load_px24_sse2(in)),
+            luma_sse2(load_px24_sse2(in + 12)),
+            luma_sse2(load_px24_sse2(in + 24)),
+            luma_sse2(load_px24_sse2(in + 36)));
+
+        in += 48;
+        out += 16;
+    }
+
+    rgb8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void bgra8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        store_y16_sse2(out,
+            luma_sse2(_mm_loadu_si128((const __m128i *)in)),
+            luma_sse2(_mm_loadu_si128((const __m128i *)(in + 16))),
+            luma_sse2(_mm_loadu_si128((const __m128i *)(in + 32))),
+            luma_sse2(_mm_loadu_si128((const __m128i *)(in + 48))));
+
+        in += 64;
+        out += 16;
+    }
+
+    bgra8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void uyvy8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        /* luma is the high byte of every 16-bit word */
+        __m128i a = _mm_srli_epi16(_mm_loadu_si128((const __m128i *)in), 8);
+        __m128i b = _mm_srli_epi16(_mm_loadu_si128((const __m128i *)(in + 16)), 8);
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+
+        in += 32;
+        out += 16;
+    }
+
+    uyvy8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void yuv8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        store_y16_sse2(out,
+            _mm_and_si128(load_px24_sse2(in), byte_mask),
+            _mm_and_si128(load_px24_sse2(in + 12), byte_mask),
+            _mm_and_si128(load_px24_sse2(in + 24), byte_mask),
+            _mm_and_si128(load_px24_sse2(in + 36), byte_mask));
+
+        in += 48;
+        out += 16;
+    }
+
+    yuv8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void yuva8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        store_y16_sse2(out,
+            _mm_and_si128(_mm_loadu_si128((const __m128i *)in), byte_mask),
+            _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + 16)), byte_mask),
+            _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + 32)), byte_mask),
+            _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + 48)), byte_mask));
+
+        in += 64;
+        out += 16;
+    }
+
+    yuva8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void yuyv8_to_uyvy8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)in);
+        _mm_storeu_si128((__m128i *)out,
+            _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+
+        in += 16;
+        out += 16;
+    }
+
+    yuyv8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_SSE2 void yuyv8_to_y8_sse2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m128i byte_mask = _mm_set1_epi16(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        /* luma is the low byte of every 16-bit word */
+        __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *)in), byte_mask);
+        __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + 16)), byte_mask);
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+
+        in += 32;
+        out += 16;
+    }
+
+    yuyv8_to_y8_scalar(in, out, w - j);
+}
+
+static const struct picture_kernels sse2_kernels = {
+    "sse2",
+    rgb8_to_uyvy8_sse2,
+    uyvy8_to_rgb8_sse2,
+    yuv8_to_uyvy8_sse2,
+    uyvy8_to_yuv8_sse2,
+    bgra8_to_yuva8_sse2,
+    bgra8_to_rgb8_sse2,
+    rgb8_to_y8_sse2,
+    bgra8_to_y8_sse2,
+    uyvy8_to_y8_sse2,
+    yuv8_to_y8_sse2,
+    yuva8_to_y8_sse2,
+    yuyv8_to_uyvy8_sse2,
+    yuyv8_to_y8_sse2
+};
+
+/*
+ * AVX2 kernels. Same arithmetic as the SSE2 ones, eight lanes wide.
+ * Packed 24-bit pixels are moved in and out with byte shuffles
+ * instead of the shift-and-mask dance SSE2 needs.
+ */
+
+static inline TARGET_AVX2 __m256i div256_avx2(__m256i n) {
+    __m256i bias = _mm256_and_si256(_mm256_srai_epi32(n, 31),
+        _mm256_set1_epi32(255));
+    return _mm256_srai_epi32(_mm256_add_epi32(n, bias), 8);
+}
+
+static inline TARGET_AVX2 __m256i coef_avx2(int16_t lo, int16_t hi) {
+    return _mm256_set1_epi32((int32_t)((uint16_t)lo | ((uint32_t)(uint16_t)hi << 16)));
+}
+
+static inline TARGET_AVX2 __m256i sclamp_avx2(__m256i x) {
+    __m256i in_range = _mm256_and_si256(
+        _mm256_cmpgt_epi32(x, _mm256_setzero_si256( )),
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(256), x)
+    );
+    return _mm256_and_si256(x, in_range);
+}
+
+/* 8 pixels as 0x00ccbbaa lanes -> 24 packed bytes */
+static inline TARGET_AVX2 void store_px24_avx2(uint8_t *out, __m256i px) {
+    const __m256i squeeze = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+    );
+    const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    __m256i v = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(px, squeeze), gather);
+
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(v));
+    _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(v, 1));
+}
+
+/* 24 packed bytes -> 8 pixels as 0x00ccbbaa lanes */
+static inline TARGET_AVX2 __m256i load_px24_avx2(const uint8_t *in) {
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    const __m256i expand = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+    );
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+        _mm_loadl_epi64((const __m128i *)(in + 16)), 1);
+
+    return _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), expand);
+}
+
+/* UYVY pair lanes (even lanes valid) -> 16 bytes of UYVY8 */
+static inline TARGET_AVX2 void store_pairs_avx2(uint8_t *out, __m256i uyvy) {
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    uyvy = _mm256_permutevar8x32_epi32(uyvy, evens);
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(uyvy));
+}
+
+static TARGET_AVX2 void rgb8_to_uyvy8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256i rb_mask = _mm256_set1_epi32(0x00ff00ff);
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m256i px = load_px24_avx2(in);
+        __m256i rb = _mm256_and_si256(px, rb_mask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte_mask);
+
+        __m256i y = _mm256_add_epi32(_mm256_set1_epi32(16), _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(rb, coef_avx2(66, 25)),
+                _mm256_madd_epi16(g, coef_avx2(129, 0))), 8));
+        __m256i u = _mm256_add_epi32(_mm256_set1_epi32(128), div256_avx2(
+            _mm256_add_epi32(_mm256_madd_epi16(rb, coef_avx2(-37, 112)),
+                _mm256_madd_epi16(g, coef_avx2(-74, 0)))));
+        __m256i v = _mm256_add_epi32(_mm256_set1_epi32(128), div256_avx2(
+            _mm256_add_epi32(_mm256_madd_epi16(rb, coef_avx2(112, -18)),
+                _mm256_madd_epi16(g, coef_avx2(-94, 0)))));
+
+        u = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_srli_epi64(u, 32)), 1);
+        v = _mm256_srli_epi32(_mm256_add_epi32(v, _mm256_srli_epi64(v, 32)), 1);
+
+        store_pairs_avx2(out, _mm256_or_si256(
+            _mm256_or_si256(u, _mm256_slli_epi32(y, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(v, 16),
+                _mm256_slli_epi32(_mm256_srli_epi64(y, 32), 24))
+        ));
+
+        in += 24;
+        out += 16;
+    }
+
+    rgb8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void uyvy8_to_rgb8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256i uv_mask = _mm256_set1_epi32(0x00ff00ff);
+    unsigned int j, k;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)in);
+        __m256i uv = _mm256_and_si256(d, uv_mask);
+        __m256i luma[2], px[2];
+
+        __m256i rv = _mm256_madd_epi16(uv, coef_avx2(0, 409));
+        __m256i guv = _mm256_madd_epi16(uv, coef_avx2(-100, -208));
+        __m256i bu = _mm256_madd_epi16(uv, coef_avx2(516, 0));
+
+        luma[0] = _mm256_and_si256(_mm256_srli_epi32(d, 8), byte_mask);
+        luma[1] = _mm256_srli_epi32(d, 24);
+
+        for (k = 0; k < 2; ++k) {
+            __m256i yy = _mm256_madd_epi16(luma[k], coef_avx2(298, 0));
+            __m256i r = sclamp_avx2(_mm256_sub_epi32(
+                _mm256_srai_epi32(_mm256_add_epi32(yy, rv), 8),
+                _mm256_set1_epi32(223)));
+            __m256i g = sclamp_avx2(_mm256_add_epi32(
+                div256_avx2(_mm256_add_epi32(yy, guv)), _mm256_set1_epi32(135)));
+            __m256i b = sclamp_avx2(_mm256_sub_epi32(
+                _mm256_srai_epi32(_mm256_add_epi32(yy, bu), 8),
+                _mm256_set1_epi32(277)));
+
+            px[k] = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                _mm256_slli_epi32(b, 16));
+        }
+
+        /* unpack works per 128-bit lane: lo = px 0-3|8-11, hi = px 4-7|12-15 */
+        __m256i lo = _mm256_unpacklo_epi32(px[0], px[1]);
+        __m256i hi = _mm256_unpackhi_epi32(px[0], px[1]);
+        store_px24_avx2(out, _mm256_permute2x128_si256(lo, hi, 0x20));
+        store_px24_avx2(out + 24, _mm256_permute2x128_si256(lo, hi, 0x31));
+
+        in += 32;
+        out += 48;
+    }
+
+    uyvy8_to_rgb8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void yuv8_to_uyvy8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m256i px = load_px24_avx2(in);
+        __m256i y = _mm256_and_si256(px, byte_mask);
+        __m256i u = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte_mask);
+        __m256i v = _mm256_srli_epi32(px, 16);
+
+        u = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_srli_epi64(u, 32)), 1);
+        v = _mm256_srli_epi32(_mm256_add_epi32(v, _mm256_srli_epi64(v, 32)), 1);
+
+        store_pairs_avx2(out, _mm256_or_si256(
+            _mm256_or_si256(u, _mm256_slli_epi32(y, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(v, 16),
+                _mm256_slli_epi32(_mm256_srli_epi64(y, 32), 24))
+        ));
+
+        in += 24;
+        out += 16;
+    }
+
+    yuv8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void uyvy8_to_yuv8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256i u_mask = _mm256_set1_epi32(0xff00);
+    const __m256i v_mask = _mm256_set1_epi32(0xff0000);
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)in);
+        __m256i uv = _mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi32(d, 8), u_mask),
+            _mm256_and_si256(d, v_mask));
+        __m256i px0 = _mm256_or_si256(uv,
+            _mm256_and_si256(_mm256_srli_epi32(d, 8), byte_mask));
+        __m256i px1 = _mm256_or_si256(uv, _mm256_srli_epi32(d, 24));
+
+        __m256i lo = _mm256_unpacklo_epi32(px0, px1);
+        __m256i hi = _mm256_unpackhi_epi32(px0, px1);
+        store_px24_avx2(out, _mm256_permute2x128_si256(lo, hi, 0x20));
+        store_px24_avx2(out + 24, _mm256_permute2x128_si256(lo, hi, 0x31));
+
+        in += 32;
+        out += 48;
+    }
+
+    uyvy8_to_yuv8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void bgra8_to_yuva8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i pair_mask = _mm256_set1_epi32(0x00ff00ff);
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)in);
+        __m256i br = _mm256_and_si256(px, pair_mask);
+        __m256i ga = _mm256_and_si256(_mm256_srli_epi32(px, 8), pair_mask);
+
+        __m256i y = _mm256_add_epi32(_mm256_set1_epi32(16), _mm256_srli_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(br, coef_avx2(25, 66)),
+                _mm256_madd_epi16(ga, coef_avx2(129, 0))), 8));
+        __m256i u = _mm256_add_epi32(_mm256_set1_epi32(128), div256_avx2(
+            _mm256_add_epi32(_mm256_madd_epi16(br, coef_avx2(112, -37)),
+                _mm256_madd_epi16(ga, coef_avx2(-74, 0)))));
+        __m256i v = _mm256_add_epi32(_mm256_set1_epi32(128), div256_avx2(
+            _mm256_add_epi32(_mm256_madd_epi16(br, coef_avx2(-18, 112)),
+                _mm256_madd_epi16(ga, coef_avx2(-94, 0)))));
+        __m256i a = _mm256_srli_epi32(px, 24);
+
+        _mm256_storeu_si256((__m256i *)out, _mm256_or_si256(
+            _mm256_or_si256(y, _mm256_slli_epi32(u, 8)),
+            _mm256_or_si256(_mm256_slli_epi32(v, 16), _mm256_slli_epi32(a, 24))
+        ));
+
+        in += 32;
+        out += 32;
+    }
+
+    bgra8_to_yuva8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void bgra8_to_rgb8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    /* pick r, g, b out of each 32-bit pixel and pack them in one shuffle */
+    const __m256i swizzle = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+    const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    unsigned int j;
+
+    for (j = 0; j + 8 <= w; j += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)in);
+        __m256i rgb = _mm256_permutevar8x32_epi32(
+            _mm256_shuffle_epi8(px, swizzle), gather);
+
+        _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(rgb));
+        _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(rgb, 1));
+
+        in += 32;
+        out += 24;
+    }
+
+    bgra8_to_rgb8_scalar(in, out, w - j);
+}
+
+static inline TARGET_AVX2 __m256i luma_avx2(__m256i px) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    __m256i sum = _mm256_add_epi32(
+        _mm256_add_epi32(_mm256_and_si256(px, byte_mask),
+            _mm256_and_si256(_mm256_srli_epi32(px, 16), byte_mask)),
+        _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(px, 8), byte_mask), 1)
+    );
+    return _mm256_srli_epi32(sum, 2);
+}
+
+/* 32 lanes holding 0..255 -> 32 bytes, undoing the per-lane pack order */
+static inline TARGET_AVX2 void store_y32_avx2(uint8_t *out, __m256i a,
+        __m256i b, __m256i c, __m256i d) {
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i y = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+        _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(y, order));
+}
+
+static TARGET_AVX2 void rgb8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        store_y32_avx2(out,
+            luma_avx2(load_px24_avx2(in)),
+            luma_avx2(load_px24_avx2(in + 24)),
+            luma_avx2(load_px24_avx2(in + 48)),
+            luma_avx2(load_px24_avx2(in + 72)));
+
+        in += 96;
+        out += 32;
+    }
+
+    rgb8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void bgra8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        store_y32_avx2(out,
+            luma_avx2(_mm256_loadu_si256((const __m256i *)in)),
+            luma_avx2(_mm256_loadu_si256((const __m256i *)(in + 32))),
+            luma_avx2(_mm256_loadu_si256((const __m256i *)(in + 64))),
+            luma_avx2(_mm256_loadu_si256((const __m256i *)(in + 96))));
+
+        in += 128;
+        out += 32;
+    }
+
+    bgra8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void uyvy8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        __m256i a = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)in), 8);
+        __m256i b = _mm256_srli_epi16(_mm256_loadu_si256((const __m256i *)(in + 32)), 8);
+        /* packus interleaves the 128-bit lanes, put them back in order */
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        in += 64;
+        out += 32;
+    }
+
+    uyvy8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void yuv8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        store_y32_avx2(out,
+            _mm256_and_si256(load_px24_avx2(in), byte_mask),
+            _mm256_and_si256(load_px24_avx2(in + 24), byte_mask),
+            _mm256_and_si256(load_px24_avx2(in + 48), byte_mask),
+            _mm256_and_si256(load_px24_avx2(in + 72), byte_mask));
+
+        in += 96;
+        out += 32;
+    }
+
+    yuv8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void yuva8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        store_y32_avx2(out,
+            _mm256_and_si256(_mm256_loadu_si256((const __m256i *)in), byte_mask),
+            _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(in + 32)), byte_mask),
+            _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(in + 64)), byte_mask),
+            _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(in + 96)), byte_mask));
+
+        in += 128;
+        out += 32;
+    }
+
+    yuva8_to_y8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void yuyv8_to_uyvy8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    unsigned int j;
+
+    for (j = 0; j + 16 <= w; j += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)in);
+        _mm256_storeu_si256((__m256i *)out,
+            _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+
+        in += 32;
+        out += 32;
+    }
+
+    yuyv8_to_uyvy8_scalar(in, out, w - j);
+}
+
+static TARGET_AVX2 void yuyv8_to_y8_avx2(const uint8_t *in, uint8_t *out,
+        unsigned int w) {
+    const __m256i byte_mask = _mm256_set1_epi16(0xff);
+    unsigned int j;
+
+    for (j = 0; j + 32 <= w; j += 32) {
+        __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)in), byte_mask);
+        __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(in + 32)), byte_mask);
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        in += 64;
+        out += 32;
+    }
+
+    yuyv8_to_y8_scalar(in, out, w - j);
+}
+
+static const struct picture_kernels avx2_kernels = {
+    "avx2",
+    rgb8_to_uyvy8_avx2,
+    uyvy8_to_rgb8_avx2,
+    yuv8_to_uyvy8_avx2,
+    uyvy8_to_yuv8_avx2,
+    bgra8_to_yuva8_avx2,
+    bgra8_to_rgb8_avx2,
+    rgb8_to_y8_avx2,
+    bgra8_to_y8_avx2,
+    uyvy8_to_y8_avx2,
+    yuv8_to_y8_avx2,
+    yuva8_to_y8_avx2,
+    yuyv8_to_uyvy8_avx2,
+    yuyv8_to_y8_avx2
+};
+
+#endif
+
+const struct picture_kernels *find_picture_kernels(const char *name) {
+    if (strcmp(name, "scalar") == 0) {
+        return &scalar_kernels;
+    }
+
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init( );
+
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+#endif
+
+    return NULL;
+}
+
+static const struct picture_kernels *select_picture_kernels(void) {
+    static const char *const preference[] = { "avx2", "sse2", "scalar" };
+    const char *cap = getenv("SEVEN_SEG_SIMD");
+    const struct picture_kernels *k;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(preference) / sizeof(preference[0]); ++i) {
+        /* skip anything faster than what was asked for */
+        if (cap != NULL) {
+            if (strcmp(cap, preference[i]) != 0) {
+                continue;
+            }
+            cap = NULL;
+        }
+
+        k = find_picture_kernels(preference[i]);
+        if (k != NULL) {
+            return k;
+        }
+    }
+
+    return &scalar_kernels;
+}
+
+const struct picture_kernels *get_picture_kernels(void) {
+    static const struct picture_kernels *selected = select_picture_kernels( );
+    return selected;
+}
@@ -0,0 +1,56 @@
+#ifndef _PICTURE_KERNELS_H
+#define _PICTURE_KERNELS_H
+
+/*
+ * picture_kernels.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ *
+ * Terms and conditions for copying this file are included in the
+ * accompanying COPYING file. Otherwise, all rights reserved.
+ */
+
+#include <stdint.h>
+
+/*
+ * Scanline conversion kernels used by Picture. Each one converts a single
+ * row of w pixels. Every implementation must produce output that is
+ * byte-for-byte identical to the scalar reference.
+ */
+typedef void (*convert_row_fn)(const uint8_t *in, uint8_t *out, unsigned int w);
+
+struct picture_kernels {
+    const char *name;
+
+    convert_row_fn rgb8_to_uyvy8;
+    convert_row_fn uyvy8_to_rgb8;
+    convert_row_fn yuv8_to_uyvy8;
+    convert_row_fn uyvy8_to_yuv8;
+    convert_row_fn bgra8_to_yuva8;
+    convert_row_fn bgra8_to_rgb8;
+
+    /* 
+     * Luma-only (A8) output. Y is copied straight out of the YUV formats;
+     * for RGB it is approximated as (r + 2g + b) / 4.
+     */
+    convert_row_fn rgb8_to_y8;
+    convert_row_fn bgra8_to_y8;
+    convert_row_fn uyvy8_to_y8;
+    convert_row_fn yuv8_to_y8;
+    convert_row_fn yuva8_to_y8;
+
+    /* YUYV8 is UYVY8 with the bytes of each pair swapped */
+    convert_row_fn yuyv8_to_uyvy8;
+    convert_row_fn yuyv8_to_y8;
+};
+
+/*
+ * The best kernel set this CPU supports. Chosen once, on first use.
+ * Setting SEVEN_SEG_SIMD=scalar|sse2|avx2 in the environment caps the choice.
+ */
+const struct picture_kernels *get_picture_kernels(void);
+
+/* look up a kernel set by name; NULL if unknown or unsupported by this CPU */
+const struct picture_kernels *find_picture_kernels(const char *name);
+
+#endif
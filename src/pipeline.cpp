@@ -0,0 +1,441 @@
+/*
+ * pipeline.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "pipeline.h"
+#include "log.h"
+#include "timing.h"
+
+#include <unistd.h>
+
+#define DECODE_RING_SIZE 4
+#define PREVIEW_RING_SIZE 2
+#define OUTPUT_RING_SIZE 16
+
+/* 
+ * Wait a little before polling a ring again: spin (yielding) for a
+ * while, since the next item is usually close, then start sleeping.
+ */
+static void backoff(unsigned int *tries) {
+    if (*tries < 64) {
+        std::this_thread::yield( );
+    } else {
+        usleep(200);
+    }
+    (*tries)++;
+}
+
+Pipeline::Pipeline(CaptureSource *source, Destination *dest, 
+        const Layout *layout) 
+        : decode_ring(DECODE_RING_SIZE), preview_ring(PREVIEW_RING_SIZE),
+        output_ring(OUTPUT_RING_SIZE), filter(&debounce_time) {
+    this->source = source;
+    this->dest = dest;
+    shared_layout = *layout;
+    layout_generation.store(1);
+    decoding.store(false);
+    preview.store(true);
+    quit.store(false);
+    done.store(false);
+    keepalive.store(DEFAULT_KEEPALIVE);
+    publish_rate.store(0);
+    field_mode.store(PROGRESSIVE);
+    debounce_frames.store(1);
+    adaptive.store(false);
+    started = false;
+    source_id = 0;
+    sequence = 0;
+
+    n_captured.store(0);
+    n_decoded.store(0);
+    n_unchanged.store(0);
+    n_sent.store(0);
+    n_predicted.store(0);
+    n_preview_dropped.store(0);
+}
+
+Pipeline::~Pipeline( ) {
+    stop( );
+}
+
+void Pipeline::start(void) {
+    if (started) {
+        return;
+    }
+
+    quit.store(false);
+    capture_thread = std::thread(&Pipeline::capture_main, this);
+    decode_thread = std::thread(&Pipeline::decode_main, this);
+    output_thread = std::thread(&Pipeline::output_main, this);
+    started = true;
+}
+
+void Pipeline::stop(void) {
+    struct captured_frame captured;
+    Picture *frame;
+
+    if (!started) {
+        return;
+    }
+
+    quit.store(true);
+    /* get_frame may be waiting on a source that has gone quiet */
+    source->interrupt( );
+    capture_thread.join( );
+    decode_thread.join( );
+    output_thread.join( );
+    started = false;
+
+    /* nobody else is touching the rings now */
+    while (decode_ring.pop(&captured)) {
+        source->release_frame(captured.frame);
+    }
+    while (preview_ring.pop(&frame)) {
+        source->release_frame(frame);
+    }
+}
+
+void Pipeline::set_decoding(bool on) {
+    decoding.store(on);
+    /* a fresh start, so the first frame decoded is always sent */
+    layout_generation.fetch_add(1);
+}
+
+void Pipeline::set_layout(const Layout *layout) {
+    std::lock_guard<std::mutex> lock(layout_lock);
+    shared_layout = *layout;
+    layout_generation.fetch_add(1);
+}
+
+bool Pipeline::refresh_layout(Layout *copy, unsigned int *generation) {
+    unsigned int g = layout_generation.load( );
+
+    if (g == *generation) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(layout_lock);
+    *copy = shared_layout;
+    /* it may have moved on again while we waited for the lock */
+    *generation = layout_generation.load( );
+    return true;
+}
+
+Picture *Pipeline::get_preview(void) {
+    Picture *frame;
+
+    if (preview_ring.pop(&frame)) {
+        return frame;
+    } else {
+        return NULL;
+    }
+}
+
+void Pipeline::release_preview(Picture *frame) {
+    source->release_frame(frame);
+}
+
+void Pipeline::capture_main(void) {
+    struct captured_frame out;
+    unsigned int tries;
+
+    while (!quit.load( )) {
+        out.frame = source->get_frame( );
+        if (out.frame == NULL) {
+            done.store(true);
+            break;
+        }
+        out.captured = monotonic_ns( );
+        n_captured++;
+
+        /* sources without their own clock stamp frames as they return them */
+        if (out.frame->timestamp != 0 && out.frame->timestamp <= out.captured) {
+            capture_time.record(out.captured - out.frame->timestamp);
+        }
+
+        /* decode is behind: wait for it */
+        tries = 0;
+        while (!decode_ring.push(out)) {
+            if (quit.load( )) {
+                source->release_frame(out.frame);
+                return;
+            }
+            backoff(&tries);
+        }
+    }
+}
+
+/* 
+ * Fields of an interlaced frame are captured half a frame apart; when
+ * frames come this far apart or more, that can't be worked out.
+ */
+#define MAX_FRAME_INTERVAL 100000000ULL
+
+unsigned int split_frame(Picture *frame, enum field_order order,
+        uint64_t *last_timestamp, Picture **pictures) {
+    uint64_t field_interval = 0;
+
+    if (*last_timestamp != 0 && frame->timestamp > *last_timestamp
+            && frame->timestamp - *last_timestamp < MAX_FRAME_INTERVAL) {
+        field_interval = (frame->timestamp - *last_timestamp) / 2;
+    }
+    *last_timestamp = frame->timestamp;
+
+    switch (order) {
+        case TOP_FIELD_FIRST:
+            pictures[0] = Picture::field_view(frame, PICTURE_TOP_FIELD);
+            pictures[1] = Picture::field_view(frame, PICTURE_BOTTOM_FIELD);
+            break;
+
+        case BOTTOM_FIELD_FIRST:
+            pictures[0] = Picture::field_view(frame, PICTURE_BOTTOM_FIELD);
+            pictures[1] = Picture::field_view(frame, PICTURE_TOP_FIELD);
+            break;
+
+        default:
+            pictures[0] = frame;
+            return 1;
+    }
+
+    pictures[1]->timestamp += field_interval;
+    return 2;
+}
+
+void Pipeline::decode_main(void) {
+    Layout layout;
+    unsigned int generation = 0;
+    unsigned int since_send = 0, tries = 0, i, n;
+    /* one for frames, and one for each field */
+    SamplePlan plans[3];
+    /* as decode_layout left it, before filtering */
+    struct scoreboard_state raw;
+    struct decoded_frame out;
+    struct captured_frame in;
+    Picture *frame, *pictures[2];
+    uint64_t last_timestamp = 0;
+    bool warned_geometry = false, unsent = false;
+
+    while (!quit.load( )) {
+        if (!decode_ring.pop(&in)) {
+            backoff(&tries);
+            continue;
+        }
+        tries = 0;
+        frame = in.frame;
+        queue_time.record(monotonic_ns( ) - in.captured);
+
+        if (refresh_layout(&layout, &generation)) {
+            /* forget the last frame, so this one counts as changed */
+            raw.masks.clear( );
+            filter.reset( );
+            thresholds.reset( );
+            warned_geometry = false;
+        }
+
+        if (layout.frame_w != 0 && !warned_geometry
+                && (frame->w != layout.frame_w || frame->h != layout.frame_h)) {
+            log_msg(LOG_WARNING, "warning: layout was set up on %ux%u frames, "
+                "but these are %ux%u\n", layout.frame_w, layout.frame_h,
+                frame->w, frame->h);
+            warned_geometry = true;
+        }
+
+        if (decoding.load( )) {
+            filter.set_frames(debounce_frames.load( ));
+            n = split_frame(frame, field_mode.load( ), &last_timestamp, 
+                pictures);
+            for (i = 0; i < n; ++i) {
+                decode_picture(pictures[i], &layout, 
+                    &plans[pictures[i]->field], generation, &since_send, 
+                    &unsent, &raw, &out);
+                if (pictures[i] != frame) {
+                    Picture::free(pictures[i]);
+                }
+            }
+        }
+
+        /* the preview gets the frame if it has room; otherwise, drop it */
+        if (!preview.load( )) {
+            source->release_frame(frame);
+        } else if (!preview_ring.push(frame)) {
+            n_preview_dropped++;
+            source->release_frame(frame);
+        }
+    }
+}
+
+void Pipeline::decode_picture(Picture *p, const Layout *layout, 
+        SamplePlan *plan, unsigned int generation, unsigned int *since_send,
+        bool *unsent, struct scoreboard_state *raw, 
+        struct decoded_frame *out) {
+    uint64_t start = monotonic_ns( );
+    bool changed;
+
+    out->previous = raw->capture_time;
+    changed = decode_layout(p, layout, plan, raw, 
+        adaptive.load( ) ? &thresholds : NULL);
+    changed = filter.apply(layout, raw, changed, &out->state);
+    out->decoded = monotonic_ns( );
+    /* decode_layout stamps decode_time once sampling is done */
+    sample_time.record(out->state.decode_time - start);
+    decode_time.record(out->decoded - start);
+    n_decoded++;
+    (*since_send)++;
+
+    if (!changed) {
+        n_unchanged++;
+    }
+
+    /* 
+     * The next frames decode as unchanged, so a change that can't be
+     * passed on now must stick until it can be.
+     */
+    changed = changed || *unsent;
+
+    if (changed || (keepalive.load( ) != 0 
+            && *since_send >= keepalive.load( ))) {
+        out->generation = generation;
+        out->changed = changed;
+        /* 
+         * if output is this far behind, don't wait: a change goes with
+         * the next state instead (which is newer anyway)
+         */
+        if (output_ring.push(*out)) {
+            *since_send = 0;
+            *unsent = false;
+        } else {
+            *unsent = changed;
+        }
+    }
+}
+
+void Pipeline::output_main(void) {
+    Layout layout;
+    unsigned int generation = 0, tries = 0, rate;
+    struct decoded_frame in;
+    struct scoreboard_state predicted;
+    uint64_t start, end, next_publish = 0;
+
+    while (!quit.load( )) {
+        rate = publish_rate.load( );
+        if (rate != 0 && (start = monotonic_ns( )) >= next_publish) {
+            next_publish = start + 1000000000ULL / rate;
+            if (predictor.predict(start, &predicted)) {
+                if (log_level >= LOG_DEBUG) {
+                    fprintf(stderr, "predicted: ");
+                    print_state(stderr, &layout, &predicted);
+                }
+                predicted.source_id = source_id;
+                predicted.sequence = sequence++;
+                dest->send(&layout, &predicted);
+                n_sent++;
+                n_predicted++;
+            }
+        }
+
+        if (!output_ring.pop(&in)) {
+            backoff(&tries);
+            continue;
+        }
+        tries = 0;
+        start = monotonic_ns( );
+        output_queue_time.record(start - in.decoded);
+
+        if (refresh_layout(&layout, &generation)) {
+            predictor.reset( );
+        }
+        if (in.generation != generation) {
+            /* decoded with a layout that has since been replaced */
+            continue;
+        }
+
+        predictor.update(&layout, &in.state, in.previous);
+
+        if (in.changed && log_level >= LOG_INFO) {
+            print_state(stderr, &layout, &in.state);
+        }
+
+        in.state.source_id = source_id;
+        in.state.sequence = sequence++;
+        dest->send(&layout, &in.state);
+        end = monotonic_ns( );
+        send_time.record(end - start);
+        if (in.state.capture_time != 0 && in.state.capture_time <= end) {
+            total_time.record(end - in.state.capture_time);
+        }
+        n_sent++;
+    }
+}
+
+void print_debounce_stats(FILE *out, DigitFilter *filter) {
+    struct debounce_stats stats;
+
+    filter->get_stats(&stats);
+    fprintf(out, "debounce: %llu digit changes believed at once (clock "
+        "steps), %llu after waiting, %llu glitches suppressed\n",
+        (unsigned long long)stats.immediate, 
+        (unsigned long long)stats.delayed,
+        (unsigned long long)stats.suppressed);
+}
+
+void print_threshold_stats(FILE *out, AdaptiveThreshold *thresholds) {
+    struct threshold_stats stats;
+
+    thresholds->get_stats(&stats);
+    fprintf(out, "thresholds: lit %.1f, unlit %.1f, margin %.1f (%.1f lately), "
+        "%llu resets\n", stats.lit, stats.unlit, stats.margin,
+        stats.mean_margin, (unsigned long long)stats.resets);
+}
+
+void Pipeline::get_stats(struct pipeline_stats *stats) {
+    stats->captured = n_captured.load( );
+    stats->decoded = n_decoded.load( );
+    stats->unchanged = n_unchanged.load( );
+    stats->sent = n_sent.load( );
+    stats->predicted = n_predicted.load( );
+    stats->preview_dropped = n_preview_dropped.load( );
+}
+
+void Pipeline::print_stats(FILE *out) {
+    struct pipeline_stats stats;
+
+    get_stats(&stats);
+
+    fprintf(out, "pipeline: %llu frames captured, %llu dropped by preview\n",
+        (unsigned long long)stats.captured,
+        (unsigned long long)stats.preview_dropped);
+
+    if (stats.decoded > 0) {
+        fprintf(out, "decoder: %llu frames, %llu unchanged (%.1f%%), "
+            "%llu sent (%llu predicted)\n", (unsigned long long)stats.decoded,
+            (unsigned long long)stats.unchanged, 
+            100.0 * stats.unchanged / stats.decoded,
+            (unsigned long long)stats.sent,
+            (unsigned long long)stats.predicted);
+    }
+
+    if (debounce_frames.load( ) > 1) {
+        print_debounce_stats(out, &filter);
+    }
+    if (adaptive.load( )) {
+        print_threshold_stats(out, &thresholds);
+    }
+}
+
+void Pipeline::print_timing(FILE *out) {
+    capture_time.print(out, "capture");
+    queue_time.print(out, "queue");
+    sample_time.print(out, "sample");
+    decode_time.print(out, "decode");
+    if (debounce_frames.load( ) > 1) {
+        debounce_time.print(out, "debounce");
+    }
+    output_queue_time.print(out, "output queue");
+    send_time.print(out, "send");
+    total_time.print(out, "total");
+}
@@ -0,0 +1,226 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+/*
+ * pipeline.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "capture.h"
+#include "debounce.h"
+#include "decoder.h"
+#include "destination.h"
+#include "histogram.h"
+#include "predictor.h"
+#include "spsc_ring.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* frames between resends of unchanged data */
+#define DEFAULT_KEEPALIVE 30
+
+/* frame counters of a Pipeline */
+struct pipeline_stats {
+    uint64_t captured;          /* frames from the source */
+    uint64_t decoded;           /* frames run through the decoder */
+    uint64_t unchanged;         /* decoded frames with no segment changes */
+    uint64_t sent;              /* states handed to the Destination */
+    uint64_t predicted;         /* of those, extrapolated by the predictor */
+    uint64_t preview_dropped;   /* frames the preview had no room for */
+};
+
+/*
+ * The pictures to decode a frame as: the frame itself, or views of its
+ * two fields in the order given, the second one timestamped half a frame
+ * later (going by *last_timestamp, the previous frame's, which is then
+ * updated). Returns how many there are; fields must be freed with
+ * Picture::free before the frame is released.
+ */
+unsigned int split_frame(Picture *frame, enum field_order order,
+    uint64_t *last_timestamp, Picture **pictures);
+
+/* one line about what a DigitFilter has done */
+void print_debounce_stats(FILE *out, DigitFilter *filter);
+/* one line about how well an AdaptiveThreshold tells segments apart */
+void print_threshold_stats(FILE *out, AdaptiveThreshold *thresholds);
+
+/*
+ * Capture, decode and output, each on its own thread, connected by
+ * SPSC rings:
+ *
+ *   capture --frames--> decode --results--> output --> Destination
+ *                          |
+ *                          +--frames--> preview (get_preview)
+ *
+ * Capture waits when decode falls behind, which with a real device lets
+ * the driver drop frames. Decode never waits on the preview: frames the
+ * preview has no room for are simply released. Output waits on nothing
+ * but the network.
+ *
+ * The layout can be changed from any thread with set_layout; the decode
+ * and output threads pick up a copy of it between frames.
+ *
+ * Decoded digits can be run through a DigitFilter (set_debounce), in
+ * which case states are sent when the filtered values change.
+ *
+ * Output also runs every state through a ClockPredictor, which flags
+ * clocks starting, stopping and jumping; with set_publish_rate, it also
+ * sends the predicted state whenever that changes, checking that many
+ * times a second, so running clocks step on time rather than a frame
+ * (plus decoding) late.
+ *
+ * Every frame is timestamped (CLOCK_MONOTONIC) as it passes each stage,
+ * and the time spent in each goes into a histogram; print_timing shows
+ * them, and is safe to call while the pipeline runs.
+ */
+class Pipeline {
+    public:
+        Pipeline(CaptureSource *source, Destination *dest, const Layout *layout);
+        ~Pipeline( );
+
+        void start(void);
+        /* stop and join all threads, and give back any frames in flight */
+        void stop(void);
+
+        /* true once the source has run out of frames */
+        bool finished(void) const { return done.load( ); }
+
+        /* decode frames (otherwise they only go to the preview) */
+        void set_decoding(bool on);
+        void set_layout(const Layout *layout);
+        /* resend unchanged data after this many frames (0 = never) */
+        void set_keepalive(unsigned int frames) { keepalive.store(frames); }
+        /* tag everything decoded with this source id (default 0) */
+        void set_source_id(uint16_t id) { source_id = id; }
+        /* check for predicted clock steps hz times a second (0 = never) */
+        void set_publish_rate(unsigned int hz) { publish_rate.store(hz); }
+        /* 
+         * decode the fields of interlaced frames separately (twice the
+         * decodes, and no combing on moving digits), in this order
+         */
+        void set_field_order(enum field_order order) { field_mode.store(order); }
+        /* 
+         * believe a digit changed only when it reads the same this many
+         * frames in a row, or a clock steps to it (1 = no filtering)
+         */
+        void set_debounce(unsigned int frames) { debounce_frames.store(frames); }
+        /* 
+         * light segments by their own thresholds, which follow the
+         * lighting, instead of the layout's (off by default)
+         */
+        void set_adaptive(bool on) { adaptive.store(on); }
+        /* pass frames on to get_preview (on by default) */
+        void set_preview(bool on) { preview.store(on); }
+
+        /* 
+         * the latest frame for the preview, or NULL if there is none;
+         * hand it back with release_preview
+         */
+        Picture *get_preview(void);
+        void release_preview(Picture *frame);
+
+        void get_stats(struct pipeline_stats *stats);
+        void print_stats(FILE *out);
+        void print_timing(FILE *out);
+
+        /* frame timestamp to sent, for every state sent so far */
+        const LatencyHistogram *total_latency(void) const { return &total_time; }
+
+    protected:
+        struct captured_frame {
+            Picture *frame;
+            /* when get_frame returned it */
+            uint64_t captured;
+        };
+
+        struct decoded_frame {
+            unsigned int generation;
+            /* when decoding finished */
+            uint64_t decoded;
+            /* capture time of the frame decoded before this one */
+            uint64_t previous;
+            /* false for keepalive resends */
+            bool changed;
+            struct scoreboard_state state;
+        };
+
+        void capture_main(void);
+        void decode_main(void);
+        void output_main(void);
+
+        /* 
+         * Decode a frame or field, and pass it on to output if need be.
+         * A change that didn't fit in the output ring sets *unsent, and
+         * goes out with the next state that does.
+         */
+        void decode_picture(Picture *p, const Layout *layout, 
+            SamplePlan *plan, unsigned int generation,
+            unsigned int *since_send, bool *unsent, 
+            struct scoreboard_state *raw, struct decoded_frame *out);
+
+        /* copy the shared layout if it changed since *generation */
+        bool refresh_layout(Layout *copy, unsigned int *generation);
+
+        CaptureSource *source;
+        Destination *dest;
+
+        SpscRing<struct captured_frame> decode_ring;
+        SpscRing<Picture *> preview_ring;
+        SpscRing<struct decoded_frame> output_ring;
+
+        std::mutex layout_lock;
+        Layout shared_layout;
+        std::atomic<unsigned int> layout_generation;
+
+        std::atomic<bool> decoding;
+        std::atomic<bool> preview;
+        std::atomic<bool> quit;
+        std::atomic<bool> done;
+        std::atomic<unsigned int> keepalive;
+        std::atomic<unsigned int> publish_rate;
+        std::atomic<enum field_order> field_mode;
+        std::atomic<unsigned int> debounce_frames;
+        std::atomic<bool> adaptive;
+
+        std::thread capture_thread, decode_thread, output_thread;
+        bool started;
+
+        /* only touched by the output thread once started */
+        uint16_t source_id;
+        uint32_t sequence;
+        ClockPredictor predictor;
+
+        std::atomic<uint64_t> n_captured, n_decoded, n_unchanged, n_sent;
+        std::atomic<uint64_t> n_predicted;
+        std::atomic<uint64_t> n_preview_dropped;
+
+        /* 
+         * capture: frame timestamp to get_frame returning (driver latency)
+         * queue: waiting for the decode thread
+         * sample: reading the segment boxes
+         * decode: sampling plus interpreting the digits
+         * debounce: how long each change the filter believed waited
+         *     (0 for clock steps believed at once)
+         * output_queue: waiting for the output thread
+         * send: Destination::send
+         * total: frame timestamp to sent
+         */
+        LatencyHistogram capture_time, queue_time, sample_time, decode_time;
+        LatencyHistogram debounce_time;
+        LatencyHistogram output_queue_time, send_time, total_time;
+
+        /* run by the decode thread; their stats can be read anywhere */
+        DigitFilter filter;
+        AdaptiveThreshold thresholds;
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * predictor.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "predictor.h"
+
+#include <algorithm>
+
+/* clocks show tenths under a minute */
+#define TENTHS_BELOW 600
+#define NS_PER_TENTH 100000000ULL
+
+int32_t clock_next(int32_t value, int dir) {
+    if (dir < 0) {
+        return value > TENTHS_BELOW ? value - 10 : value - 1;
+    } else {
+        return value >= TENTHS_BELOW ? value + 10 : value + 1;
+    }
+}
+
+/* how long a running clock shows value for */
+static uint64_t clock_period(int32_t value, int dir) {
+    int32_t step = clock_next(value, dir) - value;
+
+    return (step < 0 ? -step : step) * NS_PER_TENTH;
+}
+
+ClockPredictor::ClockPredictor( ) {
+    have_state = false;
+}
+
+void ClockPredictor::reset(void) {
+    tracks.clear( );
+    published.clear( );
+    have_state = false;
+}
+
+void ClockPredictor::update(const Layout *layout, 
+        struct scoreboard_state *state, uint64_t previous) {
+    struct clock_track *t;
+    unsigned int i;
+    uint64_t when = state->capture_time, lo, hi, period;
+    int32_t v, delta;
+    int dir;
+
+    if (tracks.size( ) != layout->fields.size( ) 
+            || state->values.size( ) != layout->fields.size( )) {
+        reset( );
+        tracks.resize(layout->fields.size( ));
+        for (i = 0; i < tracks.size( ); ++i) {
+            tracks[i].value = FIELD_INVALID;
+            tracks[i].dir = 0;
+            tracks[i].since = 0;
+            tracks[i].since_lo = 0;
+            tracks[i].since_hi = 0;
+        }
+    }
+
+    for (i = 0; i < tracks.size( ); ++i) {
+        t = &tracks[i];
+        v = state->values[i];
+
+        if (layout->fields[i].rule != FIELD_CLOCK || v == FIELD_INVALID) {
+            continue;
+        }
+
+        if (t->value == FIELD_INVALID) {
+            t->value = v;
+            t->dir = 0;
+            t->since = when;
+            continue;
+        }
+
+        lo = previous != 0 && previous < when ? previous : when;
+
+        if (v == t->value) {
+            if (t->dir == 0) {
+                continue;
+            }
+
+            if (when >= t->since + clock_period(v, t->dir) * 3 / 2) {
+                t->dir = 0;
+                state->flags |= STATE_CLOCK_STOPPED;
+            } else if (published.size( ) == tracks.size( )
+                    && published[i] == clock_next(v, t->dir)) {
+                /* predicted ahead of this frame, and not proven wrong */
+                state->values[i] = published[i];
+                state->flags |= STATE_PREDICTED;
+            }
+            continue;
+        }
+
+        delta = v - t->value;
+        dir = delta < 0 ? -1 : 1;
+
+        if ((delta <= 10 && delta >= -10) && t->dir != -dir) {
+            /* one step (or a few tenths, if frames were missed) */
+            period = clock_period(t->value, dir);
+            if (t->dir == 0) {
+                state->flags |= STATE_CLOCK_STARTED;
+            }
+
+            hi = when;
+            if (t->dir == dir && t->since_hi + period >= lo 
+                    && t->since_lo + period <= hi) {
+                /* still on the beat: keep what is known about it */
+                lo = std::max(lo, t->since_lo + period);
+                hi = std::min(hi, t->since_hi + period);
+            }
+
+            t->dir = dir;
+            t->since_lo = lo;
+            t->since_hi = hi;
+            t->since = lo + (hi - lo) / 2;
+        } else {
+            state->flags |= STATE_CLOCK_JUMPED;
+            t->dir = 0;
+            t->since = when;
+        }
+        t->value = v;
+    }
+
+    last = *state;
+    have_state = true;
+    published = state->values;
+}
+
+bool ClockPredictor::predict(uint64_t now, struct scoreboard_state *state) {
+    struct clock_track *t;
+    unsigned int i;
+    uint64_t period;
+    uint8_t events = 0;
+
+    if (!have_state) {
+        return false;
+    }
+
+    predicted = published;
+    for (i = 0; i < tracks.size( ); ++i) {
+        t = &tracks[i];
+        if (t->dir == 0) {
+            continue;
+        }
+
+        period = clock_period(t->value, t->dir);
+        if (now >= t->since + period * 3 / 2) {
+            t->dir = 0;
+            events |= STATE_CLOCK_STOPPED;
+            predicted[i] = t->value;
+        } else if (now >= t->since + period 
+                && !(t->dir < 0 && t->value == 0)) {
+            predicted[i] = clock_next(t->value, t->dir);
+        } else {
+            predicted[i] = t->value;
+        }
+    }
+
+    if (events == 0 && predicted == published) {
+        return false;
+    }
+
+    published = predicted;
+    *state = last;
+    state->values = published;
+    state->flags = STATE_PREDICTED | events;
+    state->decode_time = now;
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef _PREDICTOR_H
+#define _PREDICTOR_H
+
+/*
+ * predictor.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "decoder.h"
+#include "layout.h"
+
+#include <stdint.h>
+#include <vector>
+
+/* 
+ * What a clock field showing value (tenths) shows after its next step,
+ * running down (dir < 0) or up: a second above a minute, a tenth below.
+ */
+int32_t clock_next(int32_t value, int dir);
+
+/*
+ * Works out from successive decodes whether each clock field is running
+ * (down or up) or stopped, and predicts what the board shows between
+ * frames.
+ *
+ * A clock is running when its value moves by one step of its display
+ * (a second above a minute, a tenth below). The step happened somewhere
+ * between the last frame with the old value and the first with the new
+ * one; while the clock keeps running, each step narrows that down
+ * further, since the steps are one period apart, and the middle of what
+ * is left is taken as when it happened. The next step is predicted one
+ * period after that; if it hasn't shown up half a period later still,
+ * the clock has stopped. Any other change is a jump (a reset, or the
+ * operator setting the clock). Predictions never run more than one step
+ * ahead of what was last read, so a clock that stops is off by at most
+ * one step, for at most half a period.
+ *
+ * Predicted values are what the board would show, at its own precision;
+ * the point is to change at the right moment, not to add digits.
+ *
+ * Not thread-safe; the caller serializes update( ) and predict( ).
+ */
+class ClockPredictor {
+    public:
+        ClockPredictor( );
+
+        /* forget everything, e.g. when the layout changes */
+        void reset(void);
+
+        /* 
+         * Learn from a decoded state, and set its STATE_CLOCK_* flags.
+         * previous is the capture time of the frame decoded just before
+         * it (0 if unknown). A clock that was predicted to have stepped,
+         * and hasn't been seen to stop, keeps its predicted value (and
+         * the state is flagged STATE_PREDICTED), so keepalives don't
+         * send it back in time.
+         */
+        void update(const Layout *layout, struct scoreboard_state *state,
+            uint64_t previous);
+
+        /* 
+         * The last state, with its clocks extrapolated to now (monotonic
+         * ns), and flagged STATE_PREDICTED. False (and state untouched)
+         * if that is no different from the last state updated or
+         * predicted.
+         */
+        bool predict(uint64_t now, struct scoreboard_state *state);
+
+    protected:
+        struct clock_track {
+            /* last value read, or FIELD_INVALID */
+            int32_t value;
+            /* -1 counting down, 1 counting up, 0 stopped */
+            int dir;
+            /* when value is thought to have gone up on the board */
+            uint64_t since;
+            /* and the earliest and latest it could have */
+            uint64_t since_lo, since_hi;
+        };
+
+        std::vector<struct clock_track> tracks;
+        bool have_state;
+        struct scoreboard_state last;
+        /* the values last handed out, by either update or predict */
+        std::vector<int32_t> published;
+        std::vector<int32_t> predicted;
+};
+
+#endif
@@ -27,33 +27,37 @@
 
 #include "SDL.h"
 #include "picture.h"
+#include "decoder.h"
+#include "capture.h"
+#include "destination.h"
+#include "options.h"
+#include "pipeline.h"
+#include "histogram.h"
+#include "timing.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
-
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <signal.h>
 
 #include <stdexcept>
 
-#define N_DIGITS 4
+/* where "w" saves the layout if no -f was given */
+#define DEFAULT_LAYOUT_FILE "seven_seg.layout"
 
-Picture *fixed_png;
+static volatile sig_atomic_t timing_requested = 0;
 
-struct point {
-    uint16_t x, y;
-};
+static void request_timing(int sig) {
+    (void) sig;
+    timing_requested = 1;
+}
 
 struct color {
     uint16_t r, g, b;
 };
 
-struct digit {
-    struct point segment_pos[7];
-};
-
 const struct color seg_colors[] = {
     { 102, 51, 51 }, /* brown (1) */
     { 255, 0, 0 }, /* red (2) */
@@ -65,29 +69,6 @@ const struct color seg_colors[] = {
 };
 
 
-const bool truth0[] = { false, true, true, true, true, true, true };
-const bool truth1[] = { false, false, false, true, true, false, false };
-const bool truth2[] = { true, true, true, false, true, true, false };
-const bool truth3[] = { true, false, true, true, true, true, false };
-const bool truth4[] = { true, false, false, true, true, false, true };
-const bool truth5[] = { true, false, true, true, false, true, true };
-const bool truth6[] = { true, true, true, true, false, true, true };
-const bool truth7[] = { false, false, false, true, true, true, false };
-const bool truth8[] = { true, true, true, true, true, true, true };
-const bool truth9[] = { true, false, true, true, true, true, true };
-/* an all-dead digit #0 means to interpret 1-3 as :ss.t */
-const bool truth_dead[] = { false, false, false, false, false, false, false };
-
-const bool *const seg_truth_table[] = {
-    truth0, truth1, truth2, truth3, truth4,
-    truth5, truth6, truth7, truth8, truth9,
-    truth_dead
-};
-
-Picture *read_image(void) {
-    return Picture::copy(fixed_png);
-}
-
 static void putpixel(SDL_Surface *output, int16_t x, int16_t y,
     uint8_t r, uint8_t g, uint8_t b) {
     
@@ -165,168 +146,73 @@ void overlay_segments(SDL_Surface *surf, const struct digit *d) {
     }
 }
 
-uint8_t getpixel_y(Picture *p, unsigned int x, unsigned int y) {
-    uint8_t *rgb = p->scanline(y) + 3 * x;
-    /* crudely estimate y as (r + 2g + b) / 4 */
-    uint16_t y1 = rgb[0]  + 2 * rgb[1] + rgb[2];
-    return (y1 >> 2);
-}
-
-uint16_t boxsum_y(Picture *p, const struct point *pt) {
-    int x, y;
-    uint16_t ysum = 0;
-
-    for (x = pt->x - 2; x <= pt->x + 2; ++x) {
-        for (y = pt->y - 2; y <= pt->y + 2; ++y) {
-            if (x > 0 && y > 0 && x < p->w && y < p->h) {
-                ysum += getpixel_y(p, x, y);
-            }
-        }
-    }    
-    
-    return ysum;
-}
-
-int truth_table_compare(const bool *state, const bool * const *truth_table, int bits, int n) {
-    int i, j;
-    bool flag;
-
-    for (i = 0; i < n; ++i) {
-        flag = true;
-
-        /* compare each bit */
-        for (j = 0; j < bits; ++j) {
-            if (state[j] != truth_table[i][j]) {
-                flag = false;
-            }
-        }
+/* grow or shrink every sample box of a digit, keeping them centered */
+void resize_boxes(struct digit *d, int delta) {
+    unsigned int i;
+    int bw, bh;
 
-        if (flag) {
-            return i;
+    for (i = 0; i < 7; ++i) {
+        bw = d->segment_size[i].w ? d->segment_size[i].w : DEFAULT_BOX;
+        bh = d->segment_size[i].h ? d->segment_size[i].h : DEFAULT_BOX;
+        bw += delta;
+        bh += delta;
+        if (bw >= 1 && bw <= 255 && bh >= 1 && bh <= 255) {
+            d->segment_size[i].w = bw;
+            d->segment_size[i].h = bh;
         }
     }
-
-    return -1;
 }
 
-int32_t compute_time(Picture *p, const struct digit *digits) {
-    int i, j;
-    uint16_t ythresh = 700;
-    bool states[7];
-    int digit_values[N_DIGITS];
-    /* seconds/seconds/tenths instead of minutes/minutes/seconds/seconds */
-    bool as_sst = false; 
-    uint32_t clock;
-
-    for (i = 0; i < N_DIGITS; ++i) {
-        for (j = 0; j < 7; ++j) {
-            if (boxsum_y(p, &digits[i].segment_pos[j]) > ythresh) {
-                states[j] = true;
-            } else {
-                states[j] = false;
-            }
-        }
-
-        digit_values[i] = truth_table_compare(states, seg_truth_table, 7, 11);
-
-        if (digit_values[i] == -1) {
-            fprintf(stderr, "warning: could not decode digit %d", i);
-            return -1;
-        }
-
-        if (digit_values[i] == 10) {
-            /* handle a blank digit */
-            if (i == 0) {
-                as_sst = true;
-            } else {
-                /* probably a leading blank */
-                digit_values[i] = 0;
-            }
-        }
-    }
-
-    if (as_sst) {
-        clock = digit_values[1] + digit_values[2] * 10 + digit_values[3] * 100;
-    } else {
-        if (digit_values[3] >= 6) {
-            fprintf(stderr, "warning: non-sensical time being decoded\n");
-        }
-        clock = 
-            digit_values[3] * 6000 
-            + digit_values[2] * 600 
-            + digit_values[1] * 100 
-            + digit_values[0] * 10;
-    }
-
-    /* send via socket (eventually) */
-    fprintf(stderr, "clock value = %d ", clock);
-    if (clock >= 600) {
-        fprintf(stderr, "(%d:%02d)\n", clock / 600, (clock / 10) % 60);
-    } else {
-        fprintf(stderr, "(:%02d.%d)\n", clock / 10, clock % 10);
-    }
+/* tell the user which digit setup mode is working on */
+void announce_digit(const Layout *layout, unsigned int d) {
+    const struct field *f = &layout->fields[layout->field_of(d)];
 
-    return clock;
+    fprintf(stderr, "setting up field %s, digit %u of %u (from the right)\n",
+        f->name.c_str( ), d - f->first_digit + 1, f->n_digits);
 }
 
-class Destination {
-    public:
-        Destination( ) { }
-        virtual ~Destination( ) { }
-        virtual void send(int32_t clock) { }
-};
-
-class MulticastDestination : public Destination {
-    /* a simple destination for the clock data, using sockets */
-    public:
-        MulticastDestination( ) {
-            /* Winsock crap goes here! */
-
-            socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-            if (socket_fd == -1) {
-                throw std::runtime_error("socket() failed");
-            }
-
-            memset(&dest, 0, sizeof(dest));
-            
-            dest.sin_family = AF_INET;
-            dest.sin_port = htons(30004);
-            inet_aton("239.160.181.93", &dest.sin_addr);
-        }
-
-        ~MulticastDestination( ) {
-            close(socket_fd);
-        }
-
-        virtual void send(int32_t clock) {
-            clock = htonl(clock);
-            sendto(socket_fd, &clock, sizeof(clock), 0, 
-                    (struct sockaddr *)&dest, sizeof(dest));
-        }
-
-    protected:
-        int socket_fd;
-        struct sockaddr_in dest;
-};
-
-int main(void) {
+int main(int argc, char **argv) {
     SDL_Surface *screen;
     SDL_Surface *frame_buf;
     SDL_Event evt;
-    MulticastDestination dest;
-
-    Picture *in_frame;
-    Picture *png = Picture::from_png("hockey_clock.png");
-    fixed_png = png->convert_to_format(RGB8);
-    Picture::free(png);
+    Destination *dest;
+    Layout layout;
+    struct options opts;
+    const char *save_file;
+    CaptureSource *source;
+    Pipeline *pipeline;
+
+    Picture *in_frame, *preview, *roi;
+    /* converting and drawing preview frames */
+    LatencyHistogram preview_time;
+    uint64_t start, next_timing;
 
     unsigned int digit_being_initialized = 0;
     unsigned int segment_being_initialized = 0;
     enum { RUNNING, SETUP_DIGITS } mode = SETUP_DIGITS;
 
-    struct digit digits[N_DIGITS];
+    if (!parse_options(argc, argv, &opts)) {
+        return 1;
+    }
 
-    memset(digits, 0, sizeof(digits));
+    /* one feed at a time here; the headless program does several */
+    save_file = opts.layout_files.empty( ) ? DEFAULT_LAYOUT_FILE 
+        : opts.layout_files[0];
+
+    try {
+        if (!opts.layout_files.empty( ) && access(save_file, F_OK) == 0) {
+            layout.load(save_file);
+            /* warm start: decode from the very first frame */
+            mode = RUNNING;
+        } else {
+            layout.parse(opts.layout_spec);
+        }
+        source = open_capture_source(opts.sources[0]);
+        dest = open_destinations(opts.sinks, opts.format);
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what( ));
+        return 1;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_NOPARACHUTE) != 0) {
         fprintf(stderr, "Failed to initialize SDL!\n");
@@ -347,21 +233,56 @@ int main(void) {
         return 1;
     }
 
-    for (;;) {
-        /* read frame */
-        in_frame = read_image( );
-    
-        /* draw frame on screen */
-        blit_picture_to_sdl(in_frame, frame_buf);
+    /* capture, decoding and output run on their own threads from here */
+    pipeline = new Pipeline(source, dest, &layout);
+    pipeline->set_keepalive(opts.keepalive);
+    pipeline->set_publish_rate(opts.publish_rate);
+    pipeline->set_field_order(opts.field_order);
+    pipeline->set_debounce(opts.debounce);
+    pipeline->set_adaptive(opts.adaptive);
+    pipeline->set_source_id(opts.source_id);
+    pipeline->set_decoding(mode == RUNNING);
+    pipeline->start( );
+
+    signal(SIGUSR1, request_timing);
+    next_timing = monotonic_ns( ) + opts.stats_interval * 1000000000ULL;
+
+    while (!pipeline->finished( )) {
+        if (timing_requested || (opts.stats_interval != 0 
+                && monotonic_ns( ) >= next_timing)) {
+            timing_requested = 0;
+            next_timing = monotonic_ns( ) + opts.stats_interval * 1000000000ULL;
+            pipeline->print_timing(stderr);
+            preview_time.print(stderr, "preview");
+        }
 
-        Picture::free(in_frame);
+        /* 
+         * draw the latest frame on screen (only what fits on it gets 
+         * converted); if there isn't a new one, keep showing the last
+         */
+        in_frame = pipeline->get_preview( );
+        if (in_frame != NULL) {
+            start = monotonic_ns( );
+
+            /* remembered in the layout file */
+            layout.frame_w = in_frame->w;
+            layout.frame_h = in_frame->h;
+
+            roi = Picture::view(in_frame, 0, 0, frame_buf->w, frame_buf->h);
+            preview = roi->convert_to_format(RGB8);
+            blit_picture_to_sdl(preview, frame_buf);
+            Picture::free(preview);
+            Picture::free(roi);
+            pipeline->release_preview(in_frame);
+
+            preview_time.record(monotonic_ns( ) - start);
+        } else {
+            SDL_Delay(5);
+        }
 
-        if (mode == RUNNING) {
-            /* do processing */
-            dest.send(compute_time(in_frame, digits));
-        } else if (mode == SETUP_DIGITS) {
+        if (mode == SETUP_DIGITS) {
             /* overlay the segment positions selected */
-            overlay_segments(frame_buf, &digits[digit_being_initialized]);
+            overlay_segments(frame_buf, &layout.digits[digit_being_initialized]);
             draw_box(frame_buf, 2, 317, &seg_colors[segment_being_initialized]);
             draw_box(frame_buf, 7, 317, &seg_colors[segment_being_initialized]);
         }
@@ -380,29 +301,55 @@ int main(void) {
                         digit_being_initialized = 0;
                         segment_being_initialized = 0;
                         mode = SETUP_DIGITS;
+                        pipeline->set_decoding(false);
+                        announce_digit(&layout, digit_being_initialized);
                         break;
 
                     case SDLK_r:
                         mode = RUNNING;
+                        pipeline->set_layout(&layout);
+                        pipeline->set_decoding(true);
                         break;
                         
                     case SDLK_n:
                         digit_being_initialized++;
-                        if (digit_being_initialized == N_DIGITS) {
+                        if (digit_being_initialized == layout.digits.size( )) {
                             digit_being_initialized = 0;
                         }
+                        announce_digit(&layout, digit_being_initialized);
+                        break;
+
+                    case SDLK_EQUALS:
+                        resize_boxes(&layout.digits[digit_being_initialized], 2);
+                        pipeline->set_layout(&layout);
+                        break;
+
+                    case SDLK_MINUS:
+                        resize_boxes(&layout.digits[digit_being_initialized], -2);
+                        pipeline->set_layout(&layout);
+                        break;
+
+                    case SDLK_w:
+                        try {
+                            layout.save(save_file);
+                            fprintf(stderr, "layout saved to %s\n", save_file);
+                        } catch (std::runtime_error &e) {
+                            fprintf(stderr, "%s\n", e.what( ));
+                        }
+                        break;
                         
                     default:
                         break;
                 }
             } else if (evt.type == SDL_MOUSEBUTTONDOWN) {
                 if (mode == SETUP_DIGITS) {
-                    digits[digit_being_initialized]
+                    layout.digits[digit_being_initialized]
                         .segment_pos[segment_being_initialized].x 
                         = evt.button.x;
-                    digits[digit_being_initialized]
+                    layout.digits[digit_being_initialized]
                         .segment_pos[segment_being_initialized].y 
                         = evt.button.y;
+                    pipeline->set_layout(&layout);
 
                     segment_being_initialized++;
 
@@ -417,6 +364,21 @@ int main(void) {
     }
 
 end:
+    pipeline->stop( );
+
+    struct picture_pool_stats pool;
+    Picture::pool_stats(&pool);
+    fprintf(stderr, "picture pool: %llu hits, %llu misses, %llu discards\n",
+        (unsigned long long)pool.hits, (unsigned long long)pool.misses,
+        (unsigned long long)pool.discards);
+    pipeline->print_stats(stderr);
+    pipeline->print_timing(stderr);
+    preview_time.print(stderr, "preview");
+
+    delete pipeline;
+    delete dest;
+    delete source;
+
     SDL_FreeSurface(screen);
     SDL_Quit( );
 }
@@ -0,0 +1,149 @@
+#ifndef _SHM_SCOREBOARD_H
+#define _SHM_SCOREBOARD_H
+
+/*
+ * shm_scoreboard.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+/*
+ * The latest decoded scoreboard state, published in POSIX shared memory
+ * (the "shm:NAME" sink), and everything a reader on the same host needs
+ * to get at it. This header stands alone and compiles as C or C++, so a
+ * renderer can just include it (and link with -lrt on older systems).
+ *
+ * The state is guarded by a seqlock: the writer makes seq odd, updates
+ * the state, then makes seq even again. A reader copies the state and
+ * keeps it only if seq was even and the same before and after the copy.
+ * Reads never block the writer and take no system calls.
+ *
+ *   struct shm_scoreboard *sb = shm_scoreboard_open("/seven_seg");
+ *   struct shm_scoreboard_state st;
+ *   if (sb != NULL && shm_scoreboard_read(sb, &st) == 0) {
+ *       ... st.values[0] is the clock ...
+ *   }
+ *
+ * A reader that keeps running into a write gives up after a while (the
+ * writer may have died in the middle of one), so it can go on showing
+ * the last state it got.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SHM_SCOREBOARD_MAGIC 0x37534547
+#define SHM_SCOREBOARD_VERSION 1
+
+/* flags of a state, the same as in the v2 packet */
+#define SHM_STATE_PREDICTED     0x01
+#define SHM_STATE_CLOCK_STARTED 0x02
+#define SHM_STATE_CLOCK_STOPPED 0x04
+#define SHM_STATE_CLOCK_JUMPED  0x08
+
+/* attempts shm_scoreboard_read makes before giving up */
+#define SHM_SCOREBOARD_READ_TRIES 1000
+
+/* fields and digits past these are not published */
+#define SHM_MAX_FIELDS 32
+#define SHM_MAX_DIGITS 64
+
+struct shm_scoreboard_state {
+    uint16_t source_id;
+    uint16_t n_fields;
+    uint16_t n_digits;
+    /* SHM_STATE_* */
+    uint16_t flags;
+    /* counts the states published, as in the v2 packet */
+    uint32_t sequence;
+    uint32_t reserved2;
+    /* CLOCK_MONOTONIC ns, comparable with the reader's own clock */
+    uint64_t capture_time;
+    uint64_t decode_time;
+    /* clocks in tenths of a second, -1 if unreadable */
+    int32_t values[SHM_MAX_FIELDS];
+    /* 0-255 per digit */
+    uint8_t confidence[SHM_MAX_DIGITS];
+};
+
+struct shm_scoreboard {
+    uint32_t magic;
+    uint32_t version;
+    /* the seqlock; 0 until the first state is published (and never after) */
+    uint32_t seq;
+    uint32_t reserved;
+    struct shm_scoreboard_state state;
+};
+
+/* map a published segment read-only; NULL if it isn't there (yet) */
+static inline struct shm_scoreboard *shm_scoreboard_open(const char *name) {
+    struct shm_scoreboard *sb;
+    void *addr;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    addr = mmap(NULL, sizeof(struct shm_scoreboard), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    sb = (struct shm_scoreboard *)addr;
+    if (sb->magic != SHM_SCOREBOARD_MAGIC || sb->version != SHM_SCOREBOARD_VERSION) {
+        munmap(addr, sizeof(struct shm_scoreboard));
+        return NULL;
+    }
+
+    return sb;
+}
+
+static inline void shm_scoreboard_close(struct shm_scoreboard *sb) {
+    munmap((void *)sb, sizeof(struct shm_scoreboard));
+}
+
+/* 
+ * copy out a consistent snapshot of the latest state; 0 on success, -1
+ * if nothing has been published yet, -2 if no snapshot could be had (a
+ * write was in progress every time; *out may be garbage, so keep the
+ * previous one)
+ */
+static inline int shm_scoreboard_read(const struct shm_scoreboard *sb,
+        struct shm_scoreboard_state *out) {
+    uint32_t before, after;
+    unsigned int tries;
+
+    for (tries = 0; tries < SHM_SCOREBOARD_READ_TRIES; ++tries) {
+        before = __atomic_load_n(&sb->seq, __ATOMIC_ACQUIRE);
+        if (before == 0) {
+            return -1;
+        }
+
+        if (before & 1) {
+            /* a write is in progress; it only takes a moment */
+            continue;
+        }
+
+        memcpy(out, (const void *)&sb->state, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        after = __atomic_load_n(&sb->seq, __ATOMIC_RELAXED);
+        if (after == before) {
+            return 0;
+        }
+    }
+
+    return -2;
+}
+
+#endif
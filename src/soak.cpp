@@ -0,0 +1,227 @@
+/*
+ * soak.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+/*
+ * seven_seg_soak: run the decoder flat out on synthetic frames with
+ * known values, and report how many it read right and how fast.
+ */
+
+#include "synth.h"
+#include "decoder.h"
+#include "destination.h"
+#include "log.h"
+#include "pipeline.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#define DEFAULT_SOAK_TIME 10
+
+/* per-field tallies */
+struct field_score {
+    uint64_t right;
+    uint64_t wrong;
+    /* decoded as FIELD_INVALID */
+    uint64_t unreadable;
+};
+
+/*
+ * Checks every state against what the frame it came from showed.
+ * Only called from the pipeline's output thread.
+ */
+class AccuracyCheck : public Destination {
+    public:
+        AccuracyCheck(SynthSource *source, unsigned int n_fields)
+                : scores(n_fields) {
+            this->source = source;
+            unknown = 0;
+        }
+
+        virtual void send(const Layout *layout,
+                const struct scoreboard_state *state) {
+            unsigned int i;
+
+            (void) layout;
+
+            if (!source->truth(state->capture_time, &want)) {
+                unknown++;
+                return;
+            }
+
+            for (i = 0; i < scores.size( ) && i < state->values.size( ); ++i) {
+                if (state->values[i] == want[i]) {
+                    scores[i].right++;
+                } else if (state->values[i] == FIELD_INVALID) {
+                    scores[i].unreadable++;
+                } else {
+                    scores[i].wrong++;
+                    log_wrong(layout, i, state->values[i], want[i]);
+                }
+            }
+        }
+
+        std::vector<struct field_score> scores;
+        /* states from frames too old to check */
+        uint64_t unknown;
+
+    protected:
+        void log_wrong(const Layout *layout, unsigned int i, int32_t got,
+                int32_t expected) {
+            if (log_level >= LOG_DEBUG) {
+                fprintf(stderr, "%s: read %d, showing %d\n",
+                    layout->fields[i].name.c_str( ), got, expected);
+            }
+        }
+
+        SynthSource *source;
+        std::vector<int32_t> want;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void) sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [-s WxH] [-g settings] [-t secs] [-a] [-w file] [-v]\n"
+        "  -s WxH      frame size (default 1920x1080)\n"
+        "  -g settings how bad the picture is: noise=N (luma std deviation),\n"
+        "              blur=N (radius), glare=F (0-1), jitter=N (pixels),\n"
+        "              drift=F (exposure swing, 0-1), seed=N,\n"
+        "              e.g. noise=8,blur=2,glare=0.2,jitter=3\n"
+        "  -t secs     how long to run (default %d)\n"
+        "  -a          adaptive segment thresholds\n"
+        "  -w file     just save the layout of these frames, for use with\n"
+        "              -i synth:... in the other programs\n"
+        "  -v          print every misread\n",
+        argv0, DEFAULT_SOAK_TIME);
+}
+
+int main(int argc, char **argv) {
+    struct synth_params params;
+    const char *layout_file = NULL;
+    unsigned int secs = DEFAULT_SOAK_TIME, w = 1920, h = 1080, i;
+    SynthSource *source;
+    AccuracyCheck *check;
+    Pipeline *pipeline;
+    struct pipeline_stats stats;
+    struct field_score *score;
+    uint64_t start, elapsed, checked;
+    const Layout *layout;
+    std::string settings;
+    bool adaptive = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:g:t:aw:vh")) != -1) {
+        switch (opt) {
+            case 's':
+                if (sscanf(optarg, "%ux%u", &w, &h) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'g':
+                settings = optarg;
+                break;
+            case 't':
+                secs = atoi(optarg);
+                break;
+            case 'a':
+                adaptive = true;
+                break;
+            case 'w':
+                layout_file = optarg;
+                break;
+            case 'v':
+                log_level = LOG_DEBUG;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || w > 65535 || h > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        synth_default_params(&params, w, h);
+        parse_synth_params(settings, &params);
+        source = new SynthSource(&params);
+        layout = source->get_layout( );
+
+        if (layout_file != NULL) {
+            layout->save(layout_file);
+            fprintf(stderr, "layout saved to %s\n", layout_file);
+            delete source;
+            return 0;
+        }
+    } catch (std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what( ));
+        return 1;
+    }
+
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+
+    check = new AccuracyCheck(source, layout->fields.size( ));
+    pipeline = new Pipeline(source, check, layout);
+    /* check every frame, not just the ones where something changed */
+    pipeline->set_keepalive(1);
+    pipeline->set_preview(false);
+    pipeline->set_decoding(true);
+    pipeline->set_adaptive(adaptive);
+
+    start = monotonic_ns( );
+    pipeline->start( );
+    while (!stop_requested && monotonic_ns( ) - start < secs * 1000000000ULL) {
+        usleep(100000);
+    }
+    pipeline->stop( );
+    elapsed = monotonic_ns( ) - start;
+
+    pipeline->get_stats(&stats);
+    fprintf(stderr, "%ux%u: %llu frames in %.1f s, %.1f frames/s\n", w, h,
+        (unsigned long long)stats.decoded, elapsed / 1e9,
+        stats.decoded * 1e9 / elapsed);
+
+    for (i = 0; i < layout->fields.size( ); ++i) {
+        score = &check->scores[i];
+        checked = score->right + score->wrong + score->unreadable;
+        fprintf(stderr, "%-8s %6.2f%% right, %llu wrong, %llu unreadable "
+            "(of %llu)\n", layout->fields[i].name.c_str( ),
+            checked ? 100.0 * score->right / checked : 0.0,
+            (unsigned long long)score->wrong,
+            (unsigned long long)score->unreadable,
+            (unsigned long long)checked);
+    }
+    if (check->unknown != 0) {
+        fprintf(stderr, "%llu states came from frames too old to check\n",
+            (unsigned long long)check->unknown);
+    }
+
+    pipeline->print_stats(stderr);
+    pipeline->print_timing(stderr);
+
+    delete pipeline;
+    delete check;
+    delete source;
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+/*
+ * spsc_ring.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <atomic>
+#include <vector>
+
+/*
+ * Bounded single-producer/single-consumer queue. One thread may push
+ * and one (other) thread may pop, with no locks. Items are copied into
+ * and out of preallocated slots, so once each slot has held an item,
+ * T's that own memory (std::vector...) stop allocating too.
+ */
+template <class T>
+class SpscRing {
+    public:
+        /* capacity is rounded up to a power of two */
+        SpscRing(unsigned int capacity) {
+            unsigned int n = 1;
+
+            while (n < capacity) {
+                n <<= 1;
+            }
+
+            slots.resize(n);
+            mask = n - 1;
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        /* producer side: false (and nothing done) if the ring is full */
+        bool push(const T &item) {
+            unsigned int t = tail.load(std::memory_order_relaxed);
+
+            if (t - head.load(std::memory_order_acquire) > mask) {
+                return false;
+            }
+
+            slots[t & mask] = item;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* consumer side: false if the ring is empty */
+        bool pop(T *item) {
+            unsigned int h = head.load(std::memory_order_relaxed);
+
+            if (h == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            *item = slots[h & mask];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* consumer side: true if there is nothing to pop */
+        bool empty(void) const {
+            return head.load(std::memory_order_relaxed) 
+                == tail.load(std::memory_order_acquire);
+        }
+
+        unsigned int capacity(void) const { return mask + 1; }
+
+    protected:
+        std::vector<T> slots;
+        unsigned int mask;
+
+        /* 
+         * head is written by the consumer only, tail by the producer only;
+         * keep them on separate cache lines
+         */
+        char pad0[64];
+        std::atomic<unsigned int> head;
+        char pad1[64];
+        std::atomic<unsigned int> tail;
+        char pad2[64];
+};
+
+#endif
@@ -0,0 +1,604 @@
+/*
+ * synth.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "synth.h"
+#include "decoder.h"
+#include "timing.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <stdexcept>
+
+/* colors of lit and unlit segments (amber LEDs) */
+#define LIT_R 255
+#define LIT_G 150
+#define LIT_B 0
+#define DIM_R 60
+#define DIM_G 35
+#define DIM_B 0
+
+/* the same, as luma */
+#define LIT_Y 156
+#define DIM_Y 48
+#define BACKGROUND_Y 20
+
+/* brightest the glare gets, at glare=1 */
+#define GLARE_Y 180
+
+/* frames SynthSource remembers the values of */
+#define SYNTH_HISTORY 256
+
+/* segment centres, in units of half a segment length (see seven_seg.cpp) */
+static const int seg_x[7] = { 0, -1, 0, 1, 1, 0, -1 };
+static const int seg_y[7] = { 0, 1, 2, 1, -1, -2, -1 };
+
+void synth_default_params(struct synth_params *params, uint16_t w, uint16_t h) {
+    params->w = w;
+    params->h = h;
+    params->noise = 0;
+    params->blur = 0;
+    params->glare = 0;
+    params->jitter = 0;
+    params->drift = 0;
+    params->seed = 1;
+}
+
+void parse_synth_params(const std::string &spec, struct synth_params *params) {
+    size_t start = 0, end, eq;
+    std::string item, name;
+    const char *value;
+    char *value_end;
+    double v;
+
+    while (start < spec.size( )) {
+        end = spec.find(',', start);
+        if (end == std::string::npos) {
+            end = spec.size( );
+        }
+        item = spec.substr(start, end - start);
+        start = end + 1;
+
+        eq = item.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("synth settings look like noise=4,blur=1");
+        }
+        name = item.substr(0, eq);
+        value = item.c_str( ) + eq + 1;
+
+        v = strtod(value, &value_end);
+        if (value_end == value || *value_end != '\0' || v < 0) {
+            throw std::runtime_error("bad synth setting: " + item);
+        }
+
+        if (name == "noise") {
+            params->noise = v;
+        } else if (name == "blur") {
+            params->blur = v;
+        } else if (name == "glare") {
+            params->glare = v > 1 ? 1 : v;
+        } else if (name == "jitter") {
+            params->jitter = v;
+        } else if (name == "drift") {
+            params->drift = v > 1 ? 1 : v;
+        } else if (name == "seed") {
+            params->seed = v;
+        } else {
+            throw std::runtime_error("unknown synth setting: " + name);
+        }
+    }
+}
+
+int32_t field_digits(const struct field *f, int32_t value, int8_t *digits) {
+    unsigned int i, n = f->n_digits;
+    int32_t minutes, kept, scale;
+
+    if (value < 0) {
+        value = 0;
+    }
+
+    for (i = 0; i < n; ++i) {
+        digits[i] = DIGIT_BLANK;
+    }
+
+    if (f->rule == FIELD_CLOCK && n >= 4 && value < 600) {
+        /* :SS.T, with digit 0 left dark to say so */
+        digits[1] = value % 10;
+        digits[2] = (value / 10) % 10;
+        if (value >= 100) {
+            digits[3] = value / 100;
+        }
+        return value;
+    } else if (f->rule == FIELD_CLOCK && n >= 4) {
+        /* MM:SS, without the tenths, or minutes that don't fit */
+        digits[0] = (value / 10) % 10;
+        digits[1] = (value / 100) % 6;
+        minutes = value / 600;
+        kept = 0;
+        scale = 1;
+        for (i = 2; i < n; ++i) {
+            if (i > 2 && minutes == 0) {
+                break;
+            }
+            digits[i] = minutes % 10;
+            kept += digits[i] * scale;
+            minutes /= 10;
+            scale *= 10;
+        }
+        return kept * 600 + (value % 600) / 10 * 10;
+    } else {
+        /* plain number, without leading zeros */
+        kept = 0;
+        scale = 1;
+        for (i = 0; i < n; ++i) {
+            if (i > 0 && value == 0) {
+                break;
+            }
+            digits[i] = value % 10;
+            kept += digits[i] * scale;
+            value /= 10;
+            scale *= 10;
+        }
+        return kept;
+    }
+}
+
+SynthScoreboard::SynthScoreboard(const struct synth_params *params) {
+    uint8_t *line;
+    unsigned int x, y;
+
+    if (params->w < 64 || params->h < 64 || params->w % 2 != 0) {
+        throw std::runtime_error("SynthScoreboard: bad frame size");
+    }
+
+    this->params = *params;
+    /* xorshift gets stuck on zero */
+    rng = params->seed ? params->seed : 1;
+    n_rendered = 0;
+
+    make_layout( );
+    make_segments( );
+    make_labels( );
+
+    background = Picture::alloc(params->w, params->h, 2 * params->w, UYVY8);
+    for (y = 0; y < params->h; ++y) {
+        line = background->scanline(y);
+        for (x = 0; x < 2u * params->w; x += 2) {
+            line[x] = 128;
+            line[x + 1] = BACKGROUND_Y;
+        }
+    }
+
+    scratch = Picture::alloc(area_w, area_h, 3 * area_w, YUV8);
+    glare_x = area_w / 4;
+    glare_y = area_h / 2;
+}
+
+SynthScoreboard::~SynthScoreboard( ) {
+    unsigned int i;
+
+    for (i = 0; i < labels.size( ); ++i) {
+        Picture::free(labels[i]);
+    }
+    Picture::free(bar_h);
+    Picture::free(bar_v);
+    Picture::free(scratch);
+    Picture::free(background);
+}
+
+uint32_t SynthScoreboard::random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/*
+ * Clock, scores and period in a row across the middle of the frame,
+ * fields half a digit apart, each digit as wide as the frame allows.
+ */
+void SynthScoreboard::make_layout(void) {
+    unsigned int f, k, i, j, pitch, half, box, left, right, top, bottom;
+    int cx, cy;
+    struct digit *d;
+
+    layout.parse("clock:clock:4,home:int:2,away:int:2,period:int:1");
+    layout.frame_w = params.w;
+    layout.frame_h = params.h;
+    /* halfway between lit and unlit segments */
+    layout.threshold = (LIT_Y + DIM_Y) / 2;
+
+    /* the digits, the gaps between fields, and a digit's margin each side */
+    pitch = 2 * params.w / (2 * layout.digits.size( ) + layout.fields.size( ) + 3);
+    if (pitch > params.h / 3u) {
+        pitch = params.h / 3;
+    }
+    half = pitch / 4;
+    box = half / 2 < 3 ? 3 : half / 2;
+
+    cy = params.h / 2;
+    left = pitch;
+    for (f = 0; f < layout.fields.size( ); ++f) {
+        for (k = 0; k < layout.fields[f].n_digits; ++k) {
+            /* digit 0 of each field is its rightmost */
+            i = layout.fields[f].first_digit + k;
+            cx = left + (layout.fields[f].n_digits - 1 - k) * pitch + pitch / 2;
+            d = &layout.digits[i];
+            for (j = 0; j < 7; ++j) {
+                d->segment_pos[j].x = cx + seg_x[j] * (int)half;
+                d->segment_pos[j].y = cy + seg_y[j] * (int)half;
+                d->segment_size[j].w = box;
+                d->segment_size[j].h = box;
+            }
+        }
+        left += layout.fields[f].n_digits * pitch + pitch / 2;
+    }
+
+    /* 
+     * What gets redrawn: the digits, room for labels above them, and
+     * for jitter and blur all around. Whole UYVY pixel pairs.
+     */
+    top = cy - 5 * half - params.jitter - params.blur - 2;
+    bottom = cy + 3 * half + params.jitter + params.blur + 2;
+    right = left + params.jitter + params.blur;
+    area_x = (pitch / 2) & ~1;
+    area_y = (int)top < 1 ? 1 : top;
+    area_w = ((right < params.w ? right : params.w) - area_x) & ~1;
+    area_h = (bottom < params.h ? bottom : params.h) - area_y;
+}
+
+/* a bar with soft edges: full coverage inside, half on the border */
+static Picture *make_bar(uint16_t w, uint16_t h) {
+    Picture *bar = Picture::alloc(w, h, w, A8);
+    unsigned int x, y;
+
+    for (y = 0; y < h; ++y) {
+        for (x = 0; x < w; ++x) {
+            if (x == 0 || y == 0 || x == w - 1u || y == h - 1u) {
+                bar->scanline(y)[x] = 128;
+            } else {
+                bar->scanline(y)[x] = 255;
+            }
+        }
+    }
+
+    return bar;
+}
+
+void SynthScoreboard::make_segments(void) {
+    /* distance between segment centres is half a segment */
+    unsigned int half = layout.digits[0].segment_pos[3].x 
+        - layout.digits[0].segment_pos[0].x;
+    unsigned int length = 2 * half * 85 / 100, thickness = 2 * half / 3;
+
+    /* wider than the sample box, so a lit box is all lit */
+    if (thickness < layout.digits[0].segment_size[0].w + 2u) {
+        thickness = layout.digits[0].segment_size[0].w + 2u;
+    }
+
+    bar_h = make_bar(length, thickness);
+    bar_v = make_bar(thickness, length);
+}
+
+void SynthScoreboard::make_labels(void) {
+#ifdef HAVE_PANGOCAIRO
+    const struct digit *rightmost, *leftmost;
+    unsigned int f, i, height, width, above;
+    struct point pos;
+    Picture *text;
+    std::string name;
+
+    /* text as tall as half a segment, clear of the top segments */
+    height = layout.digits[0].segment_pos[3].x - layout.digits[0].segment_pos[0].x;
+    if (height < 8) {
+        return;
+    }
+    above = bar_h->h / 2 + 2 * height + 2;
+
+    for (f = 0; f < layout.fields.size( ); ++f) {
+        rightmost = &layout.digits[layout.fields[f].first_digit];
+        leftmost = &layout.digits[layout.fields[f].first_digit 
+            + layout.fields[f].n_digits - 1];
+        width = rightmost->segment_pos[3].x - leftmost->segment_pos[6].x 
+            + 2 * height;
+
+        name = layout.fields[f].name;
+        for (i = 0; i < name.size( ); ++i) {
+            name[i] = toupper(name[i]);
+        }
+
+        text = Picture::alloc(width, 2 * height, 4 * width, BGRA8);
+        memset(text->data, 0, (size_t)text->line_pitch * text->h);
+        text->set_font("Sans", height);
+        text->render_text(0, 0, "%s", name.c_str( ));
+        labels.push_back(text->convert_to_format(YUVA8));
+        Picture::free(text);
+
+        pos.x = leftmost->segment_pos[6].x - height / 2 - area_x;
+        pos.y = leftmost->segment_pos[5].y - above - area_y;
+        label_pos.push_back(pos);
+    }
+#endif
+}
+
+/* a bright spot drifting around over the display */
+void SynthScoreboard::add_glare(void) {
+    int radius = area_h, x, y, x0, x1, y0, y1, dx, dy, d2;
+    int peak = params.glare * GLARE_Y, add;
+    uint8_t *p;
+
+    if (peak == 0) {
+        return;
+    }
+
+    glare_x += (int)(random( ) % 5) - 2;
+    glare_y += (int)(random( ) % 3) - 1;
+    glare_x = glare_x < 0 ? 0 : (glare_x >= area_w ? area_w - 1 : glare_x);
+    glare_y = glare_y < 0 ? 0 : (glare_y >= area_h ? area_h - 1 : glare_y);
+
+    x0 = glare_x - radius < 0 ? 0 : glare_x - radius;
+    x1 = glare_x + radius > area_w ? area_w : glare_x + radius;
+    y0 = glare_y - radius < 0 ? 0 : glare_y - radius;
+    y1 = glare_y + radius > area_h ? area_h : glare_y + radius;
+
+    for (y = y0; y < y1; ++y) {
+        p = scratch->scanline(y) + 3 * x0;
+        dy = y - glare_y;
+        for (x = x0; x < x1; ++x, p += 3) {
+            dx = x - glare_x;
+            d2 = dx * dx + dy * dy;
+            if (d2 < radius * radius) {
+                add = *p + peak - peak * d2 / (radius * radius);
+                *p = add > 235 ? 235 : add;
+            }
+        }
+    }
+}
+
+/* the camera's exposure (or the venue's lights) slowly going up and down */
+void SynthScoreboard::add_drift(void) {
+    int gain, x, y, v;
+    uint8_t *p;
+
+    if (params.drift == 0) {
+        return;
+    }
+
+    /* luma is scaled by gain / 256 */
+    gain = 256 * (1 + params.drift 
+        * sin(2 * M_PI * (n_rendered % SYNTH_DRIFT_FRAMES) / SYNTH_DRIFT_FRAMES));
+
+    for (y = 0; y < area_h; ++y) {
+        p = scratch->scanline(y);
+        for (x = 0; x < area_w; ++x, p += 3) {
+            v = *p * gain / 256;
+            *p = v > 235 ? 235 : v;
+        }
+    }
+}
+
+/* 
+ * Box blur of the luma: a pass along each row, then one down the
+ * columns, done a row at a time with running column sums. Edges are
+ * extended.
+ */
+void SynthScoreboard::add_blur(void) {
+    int r = params.blur, n = 2 * r + 1, x, y, sum;
+    std::vector<uint32_t> col_sum(area_w);
+    uint8_t *p, *in, *add, *sub;
+
+    if (r == 0) {
+        return;
+    }
+
+    blur_rows.resize((size_t)area_w * area_h);
+    blur_line.resize(area_w);
+
+    for (y = 0; y < area_h; ++y) {
+        p = scratch->scanline(y);
+        in = &blur_rows[(size_t)y * area_w];
+        for (x = 0; x < area_w; ++x) {
+            blur_line[x] = p[3 * x];
+        }
+        sum = blur_line[0] * (r + 1);
+        for (x = 1; x <= r; ++x) {
+            sum += blur_line[x < area_w ? x : area_w - 1];
+        }
+        for (x = 0; x < area_w; ++x) {
+            in[x] = sum / n;
+            sum += blur_line[x + r + 1 < area_w ? x + r + 1 : area_w - 1];
+            sum -= blur_line[x - r > 0 ? x - r : 0];
+        }
+    }
+
+    for (x = 0; x < area_w; ++x) {
+        col_sum[x] = blur_rows[x] * (r + 1);
+    }
+    for (y = 1; y <= r; ++y) {
+        in = &blur_rows[(size_t)(y < area_h ? y : area_h - 1) * area_w];
+        for (x = 0; x < area_w; ++x) {
+            col_sum[x] += in[x];
+        }
+    }
+
+    for (y = 0; y < area_h; ++y) {
+        p = scratch->scanline(y);
+        add = &blur_rows[(size_t)(y + r + 1 < area_h ? y + r + 1 : area_h - 1) * area_w];
+        sub = &blur_rows[(size_t)(y - r > 0 ? y - r : 0) * area_w];
+        for (x = 0; x < area_w; ++x) {
+            p[3 * x] = col_sum[x] / n;
+            col_sum[x] += add[x] - sub[x];
+        }
+    }
+}
+
+/* roughly gaussian luma noise: the sum of four random bytes */
+void SynthScoreboard::add_noise(void) {
+    int scale = params.noise * 256 / 148, x, y, v;
+    /* kept local, so it stays in a register */
+    uint32_t r = rng;
+    uint8_t *p;
+
+    if (scale == 0) {
+        return;
+    }
+
+    for (y = 0; y < area_h; ++y) {
+        p = scratch->scanline(y);
+        for (x = 0; x < area_w; ++x, p += 3) {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            v = (int)(r & 0xff) + ((r >> 8) & 0xff) + ((r >> 16) & 0xff) 
+                + (r >> 24) - 510;
+            v = *p + v * scale / 256;
+            *p = v < 0 ? 0 : (v > 255 ? 255 : v);
+        }
+    }
+
+    rng = r;
+}
+
+Picture *SynthScoreboard::render(const std::vector<int32_t> &values,
+        std::vector<int32_t> *shown) {
+    int8_t digits[MAX_FIELD_DIGITS];
+    const struct field *f;
+    const struct digit *d;
+    Picture *frame, *bar, *uyvy;
+    unsigned int i, k, j, y;
+    uint8_t mask, *line;
+    int dx = 0, dy = 0, jitter = params.jitter;
+
+    if (jitter > 0) {
+        dx = (int)(random( ) % (2 * jitter + 1)) - jitter;
+        dy = (int)(random( ) % (2 * jitter + 1)) - jitter;
+    }
+
+    for (y = 0; y < area_h; ++y) {
+        line = scratch->scanline(y);
+        for (i = 0; i < 3u * area_w; i += 3) {
+            line[i] = BACKGROUND_Y;
+            line[i + 1] = 128;
+            line[i + 2] = 128;
+        }
+    }
+
+    shown->resize(layout.fields.size( ));
+    for (i = 0; i < layout.fields.size( ); ++i) {
+        f = &layout.fields[i];
+        (*shown)[i] = field_digits(f, i < values.size( ) ? values[i] : 0, digits);
+
+        for (k = 0; k < f->n_digits; ++k) {
+            d = &layout.digits[f->first_digit + k];
+            mask = digit_segments(digits[k]);
+            for (j = 0; j < 7; ++j) {
+                bar = (j == 0 || j == 2 || j == 5) ? bar_h : bar_v;
+                if (mask & (1 << j)) {
+                    scratch->draw(bar, 
+                        d->segment_pos[j].x - area_x - bar->w / 2 + dx,
+                        d->segment_pos[j].y - area_y - bar->h / 2 + dy,
+                        LIT_R, LIT_G, LIT_B);
+                } else {
+                    scratch->draw(bar, 
+                        d->segment_pos[j].x - area_x - bar->w / 2 + dx,
+                        d->segment_pos[j].y - area_y - bar->h / 2 + dy,
+                        DIM_R, DIM_G, DIM_B);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < labels.size( ); ++i) {
+        scratch->draw(labels[i], label_pos[i].x + dx, label_pos[i].y + dy, 
+            0, 0, 0);
+    }
+
+    add_glare( );
+    add_drift( );
+    add_blur( );
+    add_noise( );
+
+    /* into a copy of the background, where the display goes */
+    uyvy = scratch->convert_to_format(UYVY8);
+    frame = Picture::copy(background);
+    for (y = 0; y < area_h; ++y) {
+        memcpy(frame->scanline(area_y + y) + 2 * area_x, uyvy->scanline(y),
+            2 * area_w);
+    }
+    Picture::free(uyvy);
+    n_rendered++;
+
+    return frame;
+}
+
+void SynthScoreboard::next_values(std::vector<int32_t> *values) {
+    if (values->size( ) != layout.fields.size( )) {
+        /* face-off: 20:00.0, 0-0, first period */
+        values->assign(layout.fields.size( ), 0);
+        (*values)[0] = 12000;
+        (*values)[3] = 1;
+        return;
+    }
+
+    if (--(*values)[0] < 0) {
+        (*values)[0] = 12000;
+        (*values)[3] = (*values)[3] % 3 + 1;
+    }
+
+    if (random( ) % 400 == 0) {
+        (*values)[1] = ((*values)[1] + 1) % 100;
+    }
+    if (random( ) % 400 == 0) {
+        (*values)[2] = ((*values)[2] + 1) % 100;
+    }
+}
+
+SynthSource::SynthSource(const struct synth_params *params) : board(params) {
+    history.resize(SYNTH_HISTORY);
+    next_history = 0;
+}
+
+SynthSource::~SynthSource( ) {
+}
+
+Picture *SynthSource::get_frame(void) {
+    std::vector<int32_t> shown;
+    Picture *frame;
+
+    board.next_values(&values);
+    frame = board.render(values, &shown);
+    frame->timestamp = monotonic_ns( );
+
+    std::lock_guard<std::mutex> lock(history_lock);
+    history[next_history].timestamp = frame->timestamp;
+    history[next_history].values.swap(shown);
+    next_history = (next_history + 1) % history.size( );
+
+    return frame;
+}
+
+void SynthSource::release_frame(Picture *frame) {
+    Picture::free(frame);
+}
+
+bool SynthSource::truth(uint64_t timestamp, std::vector<int32_t> *values) {
+    unsigned int i;
+
+    std::lock_guard<std::mutex> lock(history_lock);
+    for (i = 0; i < history.size( ); ++i) {
+        if (history[i].timestamp == timestamp && timestamp != 0) {
+            *values = history[i].values;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,168 @@
+#ifndef _SYNTH_H
+#define _SYNTH_H
+
+/*
+ * synth.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "picture.h"
+#include "capture.h"
+#include "layout.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* how clean (or not) synthetic frames are */
+struct synth_params {
+    uint16_t w, h;
+    /* standard deviation of the luma noise */
+    double noise;
+    /* radius of the box blur, in pixels (0 = sharp) */
+    unsigned int blur;
+    /* brightness of a wandering glare spot, 0 (none) to 1 */
+    double glare;
+    /* the display shakes by up to this many pixels each way */
+    unsigned int jitter;
+    /* 
+     * the exposure swings up and down by this fraction, 0 (steady) to
+     * 1, over SYNTH_DRIFT_FRAMES
+     */
+    double drift;
+    uint32_t seed;
+};
+
+/* frames the exposure takes to swing up, down and back with drift */
+#define SYNTH_DRIFT_FRAMES 900
+
+/* a clean w x h picture */
+void synth_default_params(struct synth_params *params, uint16_t w, uint16_t h);
+
+/*
+ * Fill in params from a comma-separated list of name=value settings
+ * (noise, blur, glare, jitter, drift, seed). Throws std::runtime_error on
+ * anything it doesn't understand.
+ */
+void parse_synth_params(const std::string &spec, struct synth_params *params);
+
+/*
+ * Digits of a field showing value, rightmost first, as a scoreboard
+ * would show them: no leading zeros, and clocks as MM:SS, or :SS.T
+ * under a minute. Returns the value interpret_field should read back
+ * (a clock showing MM:SS loses its tenths).
+ */
+int32_t field_digits(const struct field *f, int32_t value, int8_t *digits);
+
+/*
+ * Draws frames of a 7-segment scoreboard (game clock, two scores and a
+ * period) with known values, for testing and benchmarking the decoder.
+ *
+ * The layout is made up to suit the frame size: one row of digits
+ * across the middle of the frame. Segments are blitted as A8 masks, lit
+ * ones bright and unlit ones faintly visible, as on real LED boards;
+ * with pangocairo, the fields get labels too. Glare, exposure drift,
+ * blur and noise are then added around the display (the rest of the
+ * frame is flat).
+ */
+class SynthScoreboard {
+    public:
+        SynthScoreboard(const struct synth_params *params);
+        ~SynthScoreboard( );
+
+        const Layout *get_layout(void) const { return &layout; }
+
+        /*
+         * A new UYVY8 frame showing values (one per field). The values
+         * the decoder should read from it go into shown.
+         */
+        Picture *render(const std::vector<int32_t> &values,
+            std::vector<int32_t> *shown);
+
+        /*
+         * Move a game along by one frame: the clock runs down a tenth
+         * of a second, and now and then somebody scores.
+         */
+        void next_values(std::vector<int32_t> *values);
+
+    protected:
+        uint32_t random(void);
+        void make_layout(void);
+        void make_segments(void);
+        void make_labels(void);
+        void add_glare(void);
+        void add_drift(void);
+        void add_blur(void);
+        void add_noise(void);
+
+        struct synth_params params;
+        Layout layout;
+        uint32_t rng;
+        /* frames rendered, for the drift */
+        unsigned int n_rendered;
+
+        /* the area around the display that gets redrawn each frame */
+        uint16_t area_x, area_y, area_w, area_h;
+
+        /* the frame outside of that area */
+        Picture *background;
+        /* YUV8, area_w x area_h, where each frame is drawn */
+        Picture *scratch;
+
+        /* A8 masks of a horizontal and a vertical segment */
+        Picture *bar_h, *bar_v;
+        /* YUVA8 labels for the fields, and where they go in scratch */
+        std::vector<Picture *> labels;
+        std::vector<struct point> label_pos;
+
+        /* where the glare spot is, in scratch coordinates */
+        int glare_x, glare_y;
+
+        /* luma after the row pass of the blur, and one row of input */
+        std::vector<uint8_t> blur_rows;
+        std::vector<uint16_t> blur_line;
+};
+
+/*
+ * An endless game on a SynthScoreboard, served as fast as frames are
+ * asked for. Every frame is timestamped, and the values it shows can be
+ * looked up with truth( ) afterwards, to check what was decoded.
+ */
+class SynthSource : public CaptureSource {
+    public:
+        SynthSource(const struct synth_params *params);
+        virtual ~SynthSource( );
+
+        virtual Picture *get_frame(void);
+        virtual void release_frame(Picture *frame);
+
+        /* the layout to decode these frames with */
+        const Layout *get_layout(void) const { return board.get_layout( ); }
+
+        /*
+         * The values the frame with this timestamp shows. False if there
+         * was no such frame, or it was too long ago to remember.
+         */
+        bool truth(uint64_t timestamp, std::vector<int32_t> *values);
+
+    protected:
+        struct shown_frame {
+            uint64_t timestamp;
+            std::vector<int32_t> values;
+        };
+
+        SynthScoreboard board;
+        std::vector<int32_t> values;
+
+        std::mutex history_lock;
+        std::vector<struct shown_frame> history;
+        unsigned int next_history;
+};
+
+#endif
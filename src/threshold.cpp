@@ -0,0 +1,198 @@
+/*
+ * threshold.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "threshold.h"
+#include "log.h"
+
+#include <stdlib.h>
+
+/* levels are kept as mean luma << LEVEL_SHIFT */
+#define LEVEL_SHIFT 8
+#define LEVEL(y) ((int32_t)(y) << LEVEL_SHIFT)
+
+/* a mean moves 1/2^RATE of the way to each new level */
+#define RATE 4
+/* a side not seen for this many frames follows the board-wide mean */
+#define STALE_FRAMES 60
+/* lit and unlit means are kept at least this far apart */
+#define MIN_CONTRAST LEVEL(12)
+/*
+ * start over when every segment has been on one side for this many
+ * frames, though the brightest is at least twice the darkest
+ */
+#define RESET_FRAMES 15
+
+static int32_t toward(int32_t from, int32_t to) {
+    return from + (to - from) / (1 << RATE);
+}
+
+AdaptiveThreshold::AdaptiveThreshold( ) {
+    seed_threshold = 0;
+    board_lit = board_unlit = 0;
+    one_sided = 0;
+    lit_total = unlit_total = 0;
+    n_lit = n_unlit = 0;
+    darkest = brightest = least_margin = 0;
+
+    margin.store(0);
+    mean_margin.store(0);
+    lit_level.store(0);
+    unlit_level.store(0);
+    n_resets.store(0);
+}
+
+void AdaptiveThreshold::reset(void) {
+    models.clear( );
+    one_sided = 0;
+}
+
+void AdaptiveThreshold::seed(struct model *m, int32_t lit, int32_t unlit) {
+    m->lit = lit;
+    m->unlit = unlit;
+    m->lit_age = 0;
+    m->unlit_age = 0;
+}
+
+void AdaptiveThreshold::begin(unsigned int n_segments, uint16_t threshold) {
+    unsigned int i, n = models.size( );
+
+    if (n == 0 || threshold != seed_threshold) {
+        /* lit segments around half again as bright, unlit ones half */
+        seed_threshold = threshold;
+        board_lit = LEVEL(threshold) * 3 / 2;
+        board_unlit = LEVEL(threshold) / 2;
+        models.clear( );
+        n = 0;
+    }
+
+    if (n != n_segments) {
+        models.resize(n_segments);
+        for (i = n; i < n_segments; ++i) {
+            seed(&models[i], board_lit, board_unlit);
+        }
+    }
+
+    lit_total = unlit_total = 0;
+    n_lit = n_unlit = 0;
+    darkest = INT32_MAX;
+    brightest = 0;
+    least_margin = INT32_MAX;
+}
+
+int32_t AdaptiveThreshold::mean_level(uint32_t sum, uint32_t area) {
+    return area ? (int32_t)(((uint64_t)sum << LEVEL_SHIFT) / area) : 0;
+}
+
+bool AdaptiveThreshold::is_lit(unsigned int seg, uint32_t sum,
+        uint32_t area) const {
+    const struct model *m = &models[seg];
+
+    return mean_level(sum, area) > (m->lit + m->unlit) / 2;
+}
+
+bool AdaptiveThreshold::classify(unsigned int seg, uint32_t sum,
+        uint32_t area) {
+    struct model *m = &models[seg];
+    int32_t level, mid, distance;
+    bool lit;
+
+    level = mean_level(sum, area);
+    mid = (m->lit + m->unlit) / 2;
+    lit = level > mid;
+
+    distance = abs(level - mid);
+    if (distance < least_margin) {
+        least_margin = distance;
+    }
+    if (level < darkest) {
+        darkest = level;
+    }
+    if (level > brightest) {
+        brightest = level;
+    }
+
+    if (lit) {
+        m->lit = toward(m->lit, level);
+        m->lit_age = 0;
+        if (m->unlit_age < STALE_FRAMES) {
+            m->unlit_age++;
+        } else {
+            m->unlit = toward(m->unlit, board_unlit);
+        }
+        if (m->lit - m->unlit < MIN_CONTRAST) {
+            m->unlit = m->lit - MIN_CONTRAST;
+        }
+        lit_total += level;
+        n_lit++;
+    } else {
+        m->unlit = toward(m->unlit, level);
+        m->unlit_age = 0;
+        if (m->lit_age < STALE_FRAMES) {
+            m->lit_age++;
+        } else {
+            m->lit = toward(m->lit, board_lit);
+        }
+        if (m->lit - m->unlit < MIN_CONTRAST) {
+            m->lit = m->unlit + MIN_CONTRAST;
+        }
+        unlit_total += level;
+        n_unlit++;
+    }
+
+    return lit;
+}
+
+bool AdaptiveThreshold::end(void) {
+    unsigned int i;
+
+    if (models.empty( )) {
+        return false;
+    }
+
+    if (n_lit != 0) {
+        board_lit = toward(board_lit, lit_total / n_lit);
+    }
+    if (n_unlit != 0) {
+        board_unlit = toward(board_unlit, unlit_total / n_unlit);
+    }
+
+    margin.store(least_margin);
+    mean_margin.store(toward(mean_margin.load( ), least_margin));
+    lit_level.store(board_lit);
+    unlit_level.store(board_unlit);
+
+    if (n_lit != 0 && n_unlit != 0) {
+        one_sided = 0;
+        return false;
+    }
+
+    if (++one_sided < RESET_FRAMES || brightest < 2 * darkest
+            || brightest - darkest < 2 * MIN_CONTRAST) {
+        return false;
+    }
+
+    log_msg(LOG_WARNING, "warning: every segment reads %s; segment "
+        "thresholds start over\n", n_lit != 0 ? "lit" : "unlit");
+    board_lit = brightest;
+    board_unlit = darkest;
+    for (i = 0; i < models.size( ); ++i) {
+        seed(&models[i], board_lit, board_unlit);
+    }
+    one_sided = 0;
+    n_resets++;
+    return true;
+}
+
+void AdaptiveThreshold::get_stats(struct threshold_stats *stats) {
+    stats->margin = margin.load( ) / (double)LEVEL(1);
+    stats->mean_margin = mean_margin.load( ) / (double)LEVEL(1);
+    stats->lit = lit_level.load( ) / (double)LEVEL(1);
+    stats->unlit = unlit_level.load( ) / (double)LEVEL(1);
+    stats->resets = n_resets.load( );
+}
@@ -0,0 +1,106 @@
+#ifndef _THRESHOLD_H
+#define _THRESHOLD_H
+
+/*
+ * threshold.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+/* how well lit and unlit segments are told apart */
+struct threshold_stats {
+    /*
+     * least distance of any segment's mean luma from its threshold, in
+     * the last frame and on average lately (luma levels)
+     */
+    double margin;
+    double mean_margin;
+    /* mean luma of lit and of unlit segments, over the board */
+    double lit, unlit;
+    /* times the models were thrown away after a sudden change */
+    uint64_t resets;
+};
+
+/*
+ * On/off thresholds for each segment that follow the lighting, instead
+ * of the layout's one fixed threshold.
+ *
+ * Every segment keeps the mean luma it has when lit and when unlit (a
+ * running 2-means): each frame, its level counts as lit if it is nearer
+ * the lit mean, and moves that mean a little towards it. The threshold
+ * is halfway between. That is O(1) per segment, and slow drift
+ * (exposure, stage lights coming up) is followed as it happens.
+ *
+ * A segment that stays lit (or unlit) for a long time learns nothing
+ * about its other state, so that one is pulled towards the board-wide
+ * mean for it instead. If the picture changes all at once (a camera
+ * iris opening, say), every segment can end up on one side of its
+ * threshold. If that lasts, and the levels are still clearly spread
+ * apart, the models start over from the darkest and brightest segments.
+ *
+ * Only one thread may call begin/classify/end; stats can be read from
+ * anywhere.
+ */
+class AdaptiveThreshold {
+    public:
+        AdaptiveThreshold( );
+
+        /* forget everything, e.g. when the layout changes */
+        void reset(void);
+
+        /*
+         * Start a frame of n_segments; models not yet made start out
+         * around threshold (the layout's mean luma of a lit segment).
+         */
+        void begin(unsigned int n_segments, uint16_t threshold);
+        /* whether segment seg, with this luma sum over area pixels, is lit */
+        bool classify(unsigned int seg, uint32_t sum, uint32_t area);
+        /*
+         * Finish a frame, after every segment has been classified. True
+         * if the models were reset, in which case the frame should be
+         * looked at again with is_lit.
+         */
+        bool end(void);
+        /* as classify, but without learning anything from the frame */
+        bool is_lit(unsigned int seg, uint32_t sum, uint32_t area) const;
+
+        void get_stats(struct threshold_stats *stats);
+
+    protected:
+        /* levels are mean luma << LEVEL_SHIFT */
+        struct model {
+            int32_t lit, unlit;
+            /* frames since each was last updated */
+            uint16_t lit_age, unlit_age;
+        };
+
+        void seed(struct model *m, int32_t lit, int32_t unlit);
+        static int32_t mean_level(uint32_t sum, uint32_t area);
+
+        std::vector<struct model> models;
+        uint16_t seed_threshold;
+
+        /* this frame's tallies */
+        int64_t lit_total, unlit_total;
+        unsigned int n_lit, n_unlit;
+        int32_t darkest, brightest, least_margin;
+
+        /* board-wide means */
+        int32_t board_lit, board_unlit;
+        /* frames in a row with every segment on the same side */
+        unsigned int one_sided;
+
+        std::atomic<int32_t> margin, mean_margin;
+        std::atomic<int32_t> lit_level, unlit_level;
+        std::atomic<uint64_t> n_resets;
+};
+
+#endif
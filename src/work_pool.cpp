@@ -0,0 +1,144 @@
+/*
+ * work_pool.cpp
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include "work_pool.h"
+
+/* which pool and worker the current thread is, if any */
+static thread_local WorkPool *current_pool = NULL;
+static thread_local unsigned int current_worker = 0;
+
+WorkPool::WorkPool(unsigned int n_threads) {
+    unsigned int i;
+
+    if (n_threads == 0) {
+        n_threads = std::thread::hardware_concurrency( );
+    }
+    if (n_threads == 0) {
+        n_threads = 1;
+    }
+
+    pending.store(0);
+    quit = false;
+    next_queue.store(0);
+    n_run.store(0);
+    n_stolen.store(0);
+
+    for (i = 0; i < n_threads; ++i) {
+        queues.push_back(new worker_queue);
+    }
+    for (i = 0; i < n_threads; ++i) {
+        threads.push_back(std::thread(&WorkPool::worker_main, this, i));
+    }
+}
+
+WorkPool::~WorkPool( ) {
+    unsigned int i;
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_lock);
+        quit = true;
+    }
+    wake.notify_all( );
+
+    for (i = 0; i < threads.size( ); ++i) {
+        threads[i].join( );
+    }
+    for (i = 0; i < queues.size( ); ++i) {
+        delete queues[i];
+    }
+}
+
+void WorkPool::submit(const task &t) {
+    push(t, false);
+}
+
+void WorkPool::submit_fair(const task &t) {
+    push(t, true);
+}
+
+void WorkPool::push(const task &t, bool fair) {
+    unsigned int q;
+
+    if (current_pool == this) {
+        q = current_worker;
+    } else {
+        /* round-robin onto the backs of the queues is fair enough */
+        q = next_queue.fetch_add(1) % queues.size( );
+        fair = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[q]->lock);
+        if (fair) {
+            /* the owner takes from the back, so this runs last */
+            queues[q]->tasks.push_front(t);
+        } else {
+            queues[q]->tasks.push_back(t);
+        }
+    }
+
+    pending.fetch_add(1);
+    /* 
+     * A worker going to sleep checks pending with sleep_lock held, so
+     * taking it here means the wakeup can't slip in before its wait.
+     */
+    {
+        std::lock_guard<std::mutex> lock(sleep_lock);
+    }
+    wake.notify_one( );
+}
+
+bool WorkPool::take(unsigned int self, task *t) {
+    unsigned int i, victim;
+
+    {
+        std::lock_guard<std::mutex> lock(queues[self]->lock);
+        if (!queues[self]->tasks.empty( )) {
+            *t = std::move(queues[self]->tasks.back( ));
+            queues[self]->tasks.pop_back( );
+            return true;
+        }
+    }
+
+    for (i = 1; i < queues.size( ); ++i) {
+        victim = (self + i) % queues.size( );
+        std::lock_guard<std::mutex> lock(queues[victim]->lock);
+        if (!queues[victim]->tasks.empty( )) {
+            *t = std::move(queues[victim]->tasks.front( ));
+            queues[victim]->tasks.pop_front( );
+            n_stolen++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkPool::worker_main(unsigned int self) {
+    task t;
+
+    current_pool = this;
+    current_worker = self;
+
+    for (;;) {
+        if (take(self, &t)) {
+            pending.fetch_sub(1);
+            t( );
+            t = nullptr;
+            n_run++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_lock);
+        if (pending.load( ) == 0 && quit) {
+            break;
+        }
+        wake.wait(lock, [this]( ) { return pending.load( ) > 0 || quit; });
+    }
+}
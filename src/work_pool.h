@@ -0,0 +1,82 @@
+#ifndef _WORK_POOL_H
+#define _WORK_POOL_H
+
+/*
+ * work_pool.h
+ *
+ * Copyright (C) 2010 Andrew H. Armenia.
+ * This program is released under the terms of the
+ * GNU General Public License, version 3. See COPYING
+ * file for details.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of worker threads running short tasks, with work stealing:
+ * each worker has its own queue, and takes from the back of it (tasks
+ * submitted from a worker go to that worker's queue, so a task that
+ * schedules a follow-up tends to stay on the same core). A worker with
+ * nothing to do steals from the front of the others' queues, and when
+ * there is nothing anywhere, it sleeps; an idle pool uses no CPU.
+ *
+ * Tasks may be submitted from any thread. Nothing about the order they
+ * run in is promised.
+ */
+class WorkPool {
+    public:
+        typedef std::function<void (void)> task;
+
+        /* 0 threads = one per CPU */
+        WorkPool(unsigned int n_threads = 0);
+        /* runs whatever is still queued, then joins the workers */
+        ~WorkPool( );
+
+        void submit(const task &t);
+        /* 
+         * Like submit, but from a worker, t goes in behind everything
+         * already queued there (at the end others steal from), so a task
+         * that requeues itself lets the rest run first.
+         */
+        void submit_fair(const task &t);
+
+        unsigned int size(void) const { return threads.size( ); }
+
+        uint64_t tasks_run(void) const { return n_run.load( ); }
+        uint64_t tasks_stolen(void) const { return n_stolen.load( ); }
+
+    protected:
+        struct worker_queue {
+            std::mutex lock;
+            std::deque<task> tasks;
+        };
+
+        void push(const task &t, bool fair);
+        void worker_main(unsigned int self);
+        /* own queue first, then everyone else's */
+        bool take(unsigned int self, task *t);
+
+        std::vector<worker_queue *> queues;
+        std::vector<std::thread> threads;
+
+        /* tasks queued but not yet taken; workers sleep while it's 0 */
+        std::atomic<unsigned int> pending;
+        std::mutex sleep_lock;
+        std::condition_variable wake;
+        bool quit;
+
+        /* where submissions from outside the pool go next */
+        std::atomic<unsigned int> next_queue;
+
+        std::atomic<uint64_t> n_run, n_stolen;
+};
+
+#endif